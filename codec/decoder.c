@@ -1,27 +1,116 @@
 /**
  * base64url stream decoder
  * read from stdin, decode, and write to stdout.
+ * specify -r to decode each line of input as a separate record, on -j threads
+ * (default: one per CPU). each record becomes one line of hex, or with -l its
+ * length in decimal, a space and the raw bytes. an invalid record becomes a
+ * line holding "-" and the exit status is non-zero.
+ * specify --stats to print library counters to stderr on exit.
  * @author jon <jon@wroth.org>
  * CC-BY-4.0
  */
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "librb64u.h"
+#include "pipeio.h"
+#include "records.h"
+#include "stats.h"
+
+/**
+ * record mode: decode one line, see records.h
+ */
+static int record(recbuf_t *out, const char *src, size_t len, void *arg)
+{
+  static const char hex[] = "0123456789abcdef";
+  size_t i, dlen, max = len / 4 * 3 + 3;
+  char *p = recbuf_reserve(out, max * 2 + 24), *d;
+  int r, n;
+  unsigned char c;
+
+  if (NULL == p) return -1;
+  /* base64url_decode() does not reject characters outside the alphabet, it
+   * decodes them to garbage bytes; check the record first */
+  if (base64url_validate(src, len, 0, NULL, NULL) < 0) r = -1;
+  else if (*(int *)arg) {
+    /* length-prefixed: decode past the widest prefix, then move the bytes down */
+    d = p + 21;
+    r = base64url_decode(d, max, src, len, &dlen);
+    if (r >= 0) {
+      n = sprintf(p, "%lu ", (unsigned long)dlen);
+      memmove(p + n, d, dlen);
+      p[n + dlen] = '\n';
+      out->len += n + dlen + 1;
+      return 0;
+    }
+  }
+  else {
+    /* hex: decode into the upper half and expand upwards from the start,
+     * which never overtakes the bytes still to be read */
+    d = p + max;
+    r = base64url_decode(d, max, src, len, &dlen);
+    if (r >= 0) {
+      for (i = 0; i < dlen; i++) {
+        c = (unsigned char)d[i];
+        p[2 * i] = hex[c >> 4];
+        p[2 * i + 1] = hex[c & 15];
+      }
+      p[2 * dlen] = '\n';
+      out->len += 2 * dlen + 1;
+      return 0;
+    }
+  }
+  p[0] = '-';
+  p[1] = '\n';
+  out->len += 2;
+  return -1;
+}
 
 /**
  */
 int main(int argc, char **argv)
 {
-  int c, r;
+  int c, r, i, stats = 0, rec = 0, prefix = 0, jobs = 0;
   b64ud_t s;
+  pipeio_t io;
+
+  for (i = 1; i < argc; i++)
+  {
+    if (!strcmp("--stats", argv[i]))
+      stats = 1;
+    else if (!strcmp("-r", argv[i]))
+      rec = 1;
+    else if (!strcmp("-l", argv[i]))
+      prefix = 1;
+    else if (!strcmp("-j", argv[i]) && i + 1 < argc && (jobs = atoi(argv[i + 1])) > 0)
+      i++;
+    else
+      break;
+  }
+  /* -l and -j only apply to record mode */
+  if (i < argc || (!rec && (prefix || jobs))) {
+    fprintf(stderr, "usage: %s [-r [-l] [-j threads]] [--stats]\n", argv[0]);
+    return -1;
+  }
+  if (stats) atexit(print_stats);
+  if (pipeio_open(&io, 0, 1) < 0) return -1;
+  if (rec) {
+    r = records_run(&io, jobs, record, &prefix);
+    if (pipeio_close(&io) < 0) r = -1;
+    return r;
+  }
 
   base64url_decode_reset(&s);
   for (;;)
   {
-    c = getchar();
+    c = pipeio_getc(&io);
     if (EOF == c) break;
     r = base64url_decode_ingest(&s, c);
-    if (r < 0) return -1;
-    if (r > 0) printf("%c", base64url_decode_getc(&s));
+    if (r > 0) r = pipeio_putc(&io, base64url_decode_getc(&s));
+    if (r < 0) {
+      pipeio_close(&io);
+      return -1;
+    }
   }
-  return 0;
-}
\ No newline at end of file
+  return pipeio_close(&io);
+}
@@ -2,36 +2,93 @@
  * base64url stream encoder
  * read from stdin, encode, and write to stdout.
  * specify -p to include the standard padding.
+ * specify -r to encode each line of input as a separate record, one line of
+ * output per record, on -j threads (default: one per CPU).
+ * specify --stats to print library counters to stderr on exit.
  * @author jon <jon@wroth.org>
  * CC-BY-4.0
  */
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include "librb64u.h"
+#include "pipeio.h"
+#include "records.h"
+#include "stats.h"
+
+/**
+ * move r characters of output from the encoder to io
+ */
+static int drain(pipeio_t *io, b64ue_t *s, int r)
+{
+  if (r < 0) return -1;
+  while (r-- > 0)
+    if (pipeio_putc(io, base64url_encode_getc(s)) < 0) return -1;
+  return 0;
+}
+
+/**
+ * record mode: encode one line, see records.h
+ */
+static int record(recbuf_t *out, const char *src, size_t len, void *arg)
+{
+  size_t dlen, max = len / 3 * 4 + 4;
+  char *p = recbuf_reserve(out, max + 3);
+  int r;
+  if (NULL == p) return -1;
+  /* base64url_encode_padded() keeps 2 bytes of maxlen back for the padding */
+  if (*(int *)arg) r = base64url_encode_padded(p, max + 2, src, len, &dlen);
+  else r = base64url_encode(p, max, src, len, &dlen);
+  p[dlen] = '\n';
+  out->len += dlen + 1;
+  return r;
+}
 
 /**
  */
 int main(int argc, char **argv)
 {
-  int c, r;
+  int c, r, i, pad = 0, stats = 0, rec = 0, jobs = 0;
   b64ue_t s;
+  pipeio_t io;
+  for (i = 1; i < argc; i++)
+  {
+    if (!strcmp("-p", argv[i]))
+      pad = 1;
+    else if (!strcmp("-r", argv[i]))
+      rec = 1;
+    else if (!strcmp("-j", argv[i]) && i + 1 < argc && (jobs = atoi(argv[i + 1])) > 0)
+      i++;
+    else if (!strcmp("--stats", argv[i]))
+      stats = 1;
+    else
+      break;
+  }
+  /* -j only applies to record mode */
+  if (i < argc || (!rec && jobs)) {
+    fprintf(stderr, "usage: %s [-p] [-r [-j threads]] [--stats]\n", argv[0]);
+    return -1;
+  }
+  if (stats) atexit(print_stats);
+  if (pipeio_open(&io, 0, 1) < 0) return -1;
+  if (rec) {
+    r = records_run(&io, jobs, record, &pad);
+    if (pipeio_close(&io) < 0) r = -1;
+    return r;
+  }
   base64url_encode_reset(&s);
   for (;;)
   {
-    c = getchar();
+    c = pipeio_getc(&io);
     if (EOF == c) break;
-    r = base64url_encode_ingest(&s, c);
-    if (r < 0) return -1;
-    while (r-- > 0) printf("%c", base64url_encode_getc(&s));
+    if (drain(&io, &s, base64url_encode_ingest(&s, c)) < 0) {
+      pipeio_close(&io);
+      return -1;
+    }
   }
-  r = base64url_encode_finish(&s);
-  if (r < 0) return -1;
-  while (r-- > 0) printf("%c", base64url_encode_getc(&s));
-  if (argc > 1 && !strcmp("-p", argv[0]))
-  {
-    r = base64url_encode_pad(&s);
-    if (r < 0) return -1;
-    while (r-- > 0) printf("%c", base64url_encode_getc(&s));
-  }
-  return 0;
-}
\ No newline at end of file
+  r = drain(&io, &s, base64url_encode_finish(&s));
+  if (0 == r && pad)
+    r = drain(&io, &s, base64url_encode_pad(&s));
+  if (pipeio_close(&io) < 0) r = -1;
+  return r;
+}
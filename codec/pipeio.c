@@ -0,0 +1,126 @@
+/**
+ * buffered stdin/stdout for the codec tools, see pipeio.h
+ * @author jon <jon@wroth.org>
+ * CC-BY-4.0
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "pipeio.h"
+
+#define PIPEIO_BUF (64 << 10)   /* size of each buffer */
+
+/**
+ */
+static char *alloc_pages(size_t n)
+{
+  long pg = sysconf(_SC_PAGESIZE);
+  void *p;
+  if (posix_memalign(&p, pg > 0 ? (size_t)pg : 4096, n)) return NULL;
+  return p;
+}
+
+/**
+ * write out the output buffer
+ */
+static int send(pipeio_t *io)
+{
+  const char *p = io->obuf;
+  size_t n = io->olen;
+  ssize_t w;
+  io->olen = 0;
+  while (n > 0) {
+    w = write(io->ofd, p, n);
+    if (w < 0) {
+      if (EINTR == errno) continue;
+      return -1;
+    }
+    p += w;
+    n -= (size_t)w;
+  }
+  return 0;
+}
+
+/**
+ */
+int pipeio_open(pipeio_t *io, int ifd, int ofd)
+{
+  io->ifd = ifd;
+  io->ofd = ofd;
+  io->isize = io->osize = PIPEIO_BUF;
+  io->ilen = io->ipos = 0;
+  io->olen = 0;
+  io->err = 0;
+  io->ibuf = alloc_pages(io->isize);
+  io->obuf = alloc_pages(io->osize);
+  if (NULL == io->ibuf || NULL == io->obuf) {
+    free(io->ibuf);
+    free(io->obuf);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ */
+int pipeio_close(pipeio_t *io)
+{
+  if (send(io)) io->err = 1;
+  free(io->ibuf);
+  free(io->obuf);
+  io->ibuf = io->obuf = NULL;
+  io->isize = io->ilen = io->ipos = 0;
+  io->osize = 0;
+  return io->err ? -1 : 0;
+}
+
+/**
+ */
+int pipeio_fill(pipeio_t *io)
+{
+  ssize_t n;
+  io->ilen = io->ipos = 0;
+  if (NULL == io->ibuf) return EOF;
+  do n = read(io->ifd, io->ibuf, io->isize);
+  while (n < 0 && EINTR == errno);
+  if (n < 0) io->err = 1;
+  if (n <= 0) return EOF;
+  io->ilen = (size_t)n;
+  io->ipos = 1;
+  return (unsigned char)io->ibuf[0];
+}
+
+/**
+ */
+int pipeio_flush_putc(pipeio_t *io, int c)
+{
+  if (0 == io->osize) return -1;
+  if (send(io)) {
+    io->err = 1;
+    return -1;
+  }
+  io->obuf[io->olen++] = (char)c;
+  return 0;
+}
+
+/**
+ */
+int pipeio_write(pipeio_t *io, const char *p, size_t n)
+{
+  size_t k;
+  while (n > 0) {
+    if (io->olen == io->osize && (0 == io->osize || send(io))) {
+      io->err = 1;
+      return -1;
+    }
+    k = io->osize - io->olen;
+    if (k > n) k = n;
+    memcpy(io->obuf + io->olen, p, k);
+    io->olen += k;
+    p += k;
+    n -= k;
+  }
+  return 0;
+}
@@ -0,0 +1,61 @@
+/**
+ * buffered stdin/stdout for the codec tools
+ *
+ * input is read() into a page-aligned buffer, and output is collected in a
+ * page-aligned buffer and copied out with write(), a buffer at a time.
+ * @author jon <jon@wroth.org>
+ * CC-BY-4.0
+ */
+#ifndef RB64U_PIPEIO_H
+#define RB64U_PIPEIO_H
+#include <stddef.h>
+
+typedef struct pipeio
+{
+  int ifd, ofd;
+  char *ibuf;
+  size_t isize, ilen, ipos;
+  char *obuf;
+  size_t osize, olen;
+  int err;
+} pipeio_t;
+
+/**
+ * set up io on the two descriptors. returns a negative value if the buffers
+ * cannot be allocated.
+ */
+int pipeio_open(pipeio_t *io, int ifd, int ofd);
+
+/**
+ * write out buffered output, free the buffers. returns a negative value if
+ * any read or write failed.
+ */
+int pipeio_close(pipeio_t *io);
+
+/**
+ * refill the input buffer and return the next byte, or EOF
+ */
+int pipeio_fill(pipeio_t *io);
+
+/**
+ * send the current output buffer and store c at the start of the next one
+ */
+int pipeio_flush_putc(pipeio_t *io, int c);
+
+/**
+ * append n bytes of output; returns a negative value on error
+ */
+int pipeio_write(pipeio_t *io, const char *p, size_t n);
+
+/**
+ * next input byte as an unsigned char, or EOF at the end of input or on error
+ */
+#define pipeio_getc(io) ((io)->ipos < (io)->ilen ? (unsigned char)(io)->ibuf[(io)->ipos++] : pipeio_fill(io))
+
+/**
+ * append one byte of output; returns a negative value on error
+ */
+#define pipeio_putc(io, c) ((io)->olen < (io)->osize \
+  ? ((io)->obuf[(io)->olen++] = (char)(c), 0) : pipeio_flush_putc((io), (c)))
+
+#endif
@@ -0,0 +1,165 @@
+/**
+ * record mode for the codec tools, see records.h
+ * @author jon <jon@wroth.org>
+ * CC-BY-4.0
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "records.h"
+
+#define RECORDS_BATCH (1 << 20)   /* input bytes per job per batch */
+#define RECORDS_JOBS  64          /* most threads used by default */
+
+typedef struct job
+{
+  pthread_t th;
+  int started;
+  const char *src;           /* whole records */
+  size_t len;
+  recbuf_t out;
+  record_fn fn;
+  void *arg;
+  int r;
+} job_t;
+
+/**
+ */
+char *recbuf_reserve(recbuf_t *b, size_t n)
+{
+  size_t cap;
+  char *p;
+  if (b->cap - b->len < n) {
+    cap = b->cap ? b->cap : 4096;
+    while (cap - b->len < n) cap *= 2;
+    p = realloc(b->p, cap);
+    if (NULL == p) return NULL;
+    b->p = p;
+    b->cap = cap;
+  }
+  return b->p + b->len;
+}
+
+/**
+ * code the records of one slice of a batch
+ */
+static void *work(void *arg)
+{
+  job_t *j = arg;
+  const char *p = j->src, *end = j->src + j->len, *nl;
+  size_t n;
+
+  j->out.len = 0;
+  j->r = 0;
+  while (p < end) {
+    nl = memchr(p, '\n', (size_t)(end - p));
+    n = (size_t)((nl ? nl : end) - p);
+    if (n > 0 && '\r' == p[n - 1]) n--;
+    if (j->fn(&j->out, p, n, j->arg) < 0) j->r = -1;
+    p = nl ? nl + 1 : end;
+  }
+  return NULL;
+}
+
+/**
+ * read whole records into b until it holds at least want bytes or the input
+ * ends. the input buffer is copied a chunk at a time: up to its end, or once
+ * want bytes are in, up to the next newline.
+ * returns zero at the end of input, a negative value if out of memory.
+ */
+static int read_batch(pipeio_t *io, recbuf_t *b, size_t want)
+{
+  const char *p, *nl;
+  size_t n, k;
+  char *d;
+  b->len = 0;
+  for (;;) {
+    if (io->ipos == io->ilen) {
+      if (EOF == pipeio_fill(io)) break;
+      io->ipos = 0;   /* take back the byte pipeio_fill() returned */
+    }
+    p = io->ibuf + io->ipos;
+    n = io->ilen - io->ipos;
+    /* the first newline at or past k ends the batch */
+    k = b->len < want ? want - 1 - b->len : 0;
+    nl = k < n ? memchr(p + k, '\n', n - k) : NULL;
+    if (NULL != nl) n = (size_t)(nl - p) + 1;
+    d = recbuf_reserve(b, n);
+    if (NULL == d) return -1;
+    memcpy(d, p, n);
+    b->len += n;
+    io->ipos += n;
+    if (NULL != nl) break;
+  }
+  return b->len > 0;
+}
+
+/**
+ * split a batch into jobs slices at record boundaries
+ */
+static void split(job_t *job, int jobs, const char *p, size_t len)
+{
+  size_t start = 0, end, at;
+  const char *nl;
+  int i;
+  for (i = 0; i < jobs; i++) {
+    end = len;
+    if (i < jobs - 1) {
+      at = len / jobs * (i + 1);
+      if (at < start + 1) at = start + 1;
+      nl = at <= len ? memchr(p + at - 1, '\n', len - (at - 1)) : NULL;
+      end = nl ? (size_t)(nl - p) + 1 : len;
+    }
+    job[i].src = p + start;
+    job[i].len = end - start;
+    start = end;
+  }
+}
+
+/**
+ */
+int records_run(pipeio_t *io, int jobs, record_fn fn, void *arg)
+{
+  recbuf_t in[2];
+  job_t *job;
+  int i, cur = 0, more, r = 0;
+
+  if (jobs < 1) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    jobs = n < 1 ? 1 : n > RECORDS_JOBS ? RECORDS_JOBS : (int)n;
+  }
+  job = calloc((size_t)jobs, sizeof(*job));
+  if (NULL == job) return -1;
+  memset(in, 0, sizeof(in));
+  for (i = 0; i < jobs; i++) {
+    job[i].fn = fn;
+    job[i].arg = arg;
+  }
+
+  more = read_batch(io, &in[cur], (size_t)RECORDS_BATCH * jobs);
+  while (more > 0) {
+    split(job, jobs, in[cur].p, in[cur].len);
+    for (i = 0; i < jobs; i++)
+      job[i].started = 0 == pthread_create(&job[i].th, NULL, work, &job[i]);
+
+    /* read the next batch while this one is coded */
+    more = read_batch(io, &in[cur ^ 1], (size_t)RECORDS_BATCH * jobs);
+
+    for (i = 0; i < jobs; i++) {
+      if (job[i].started) pthread_join(job[i].th, NULL);
+      else work(&job[i]);
+      if (job[i].r < 0) r = -1;
+      if (pipeio_write(io, job[i].out.p, job[i].out.len) < 0) more = r = -1;
+    }
+    cur ^= 1;
+  }
+  if (more < 0) r = -1;
+
+  for (i = 0; i < jobs; i++) free(job[i].out.p);
+  free(in[0].p);
+  free(in[1].p);
+  free(job);
+  return r;
+}
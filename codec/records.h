@@ -0,0 +1,42 @@
+/**
+ * record mode for the codec tools
+ *
+ * input is a sequence of newline-delimited records, each coded on its own,
+ * with one line of output per record. input is read in batches of whole
+ * records; each batch is split across worker threads, and their output is
+ * written in input order while the next batch is read.
+ * @author jon <jon@wroth.org>
+ * CC-BY-4.0
+ */
+#ifndef RB64U_RECORDS_H
+#define RB64U_RECORDS_H
+#include <stddef.h>
+#include "pipeio.h"
+
+typedef struct recbuf
+{
+  char *p;
+  size_t len, cap;
+} recbuf_t;
+
+/**
+ * make room for n more bytes at p + len. returns p + len, or NULL if out of
+ * memory.
+ */
+char *recbuf_reserve(recbuf_t *b, size_t n);
+
+/**
+ * code one record of len bytes, without its line ending, and append its
+ * output line to out. returns a negative value if the record was invalid.
+ */
+typedef int (*record_fn)(recbuf_t *out, const char *src, size_t len, void *arg);
+
+/**
+ * code every record from io with fn on jobs threads, or one per online CPU
+ * if jobs is zero, and write the output to io. a trailing carriage return is
+ * not part of a record.
+ * returns a negative value if any record was invalid or on error.
+ */
+int records_run(pipeio_t *io, int jobs, record_fn fn, void *arg);
+
+#endif
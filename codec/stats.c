@@ -0,0 +1,29 @@
+/**
+ * --stats for the codec tools, see stats.h
+ * @author jon <jon@wroth.org>
+ * CC-BY-4.0
+ */
+#include <stdio.h>
+#include "librb64u.h"
+#include "stats.h"
+
+/**
+ */
+void print_stats(void)
+{
+  b64u_stats_t st;
+  int i;
+  if (base64url_stats_get(&st) < 0) {
+    fprintf(stderr, "stats: not compiled in (configure --enable-stats)\n");
+    return;
+  }
+  fprintf(stderr, "stats: kernel %s\n", st.kernel);
+  fprintf(stderr, "stats: calls encode %lu decode %lu ingest %lu\n",
+    (unsigned long)st.encode_calls, (unsigned long)st.decode_calls, (unsigned long)st.ingest_calls);
+  fprintf(stderr, "stats: encode in %lu out %lu\n", (unsigned long)st.encode_in, (unsigned long)st.encode_out);
+  fprintf(stderr, "stats: decode in %lu out %lu\n", (unsigned long)st.decode_in, (unsigned long)st.decode_out);
+  for (i = 0; i < RB64U_PATH_MAX; i++)
+    fprintf(stderr, "stats: path %s %lu\n", base64url_stats_path_name(i), (unsigned long)st.path[i]);
+  for (i = 0; i < RB64U_ERR_MAX; i++)
+    fprintf(stderr, "stats: error %s %lu\n", base64url_stats_error_name(i), (unsigned long)st.errors[i]);
+}
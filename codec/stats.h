@@ -0,0 +1,14 @@
+/**
+ * --stats for the codec tools
+ * @author jon <jon@wroth.org>
+ * CC-BY-4.0
+ */
+#ifndef RB64U_STATS_TOOL_H
+#define RB64U_STATS_TOOL_H
+
+/**
+ * print library counters to stderr; registered with atexit() for --stats
+ */
+void print_stats(void);
+
+#endif
@@ -8,6 +8,26 @@
 #include <stdlib.h>
 #include <stdint.h>
 
+/**
+ * define RB64U_STATIC_INLINE before including this header to compile the
+ * whole codec into the including translation unit as static functions, so the
+ * compiler can inline them into the caller's loop. otherwise the functions are
+ * declared here and linked from librb64u. the inline build is C only.
+ */
+#ifdef RB64U_STATIC_INLINE
+#ifdef __GNUC__
+#define RB64U_API static __inline__ __attribute__((unused))
+#else
+#define RB64U_API static
+#endif
+#else
+#define RB64U_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef struct b64ue b64ue_t;
 typedef struct b64ud b64ud_t;
 
@@ -39,7 +59,7 @@ struct b64ud
  * set dlen to the number of bytes written, regardless of success.
  * returns the final encoder state (a non-negative integer) on success, a negative value on failure.
  */
-int base64url_encode(char *dest, const size_t maxlen, const char *src, const size_t len, size_t *dlen);
+RB64U_API int base64url_encode(char *dest, const size_t maxlen, const char *src, const size_t len, size_t *dlen);
 
 
 /**
@@ -53,7 +73,7 @@ int base64url_encode(char *dest, const size_t maxlen, const char *src, const siz
  *
  * return zero on success, a negative value on failure.
  */
-int base64url_encode_padded(char *dest, const size_t maxlen, const char *src, const size_t len, size_t *dlen);
+RB64U_API int base64url_encode_padded(char *dest, const size_t maxlen, const char *src, const size_t len, size_t *dlen);
 
 
 /**
@@ -62,7 +82,196 @@ int base64url_encode_padded(char *dest, const size_t maxlen, const char *src, co
  * set dlen to the number of bytes written, regardless of success.
  * return zero on success, a negative value on failure.
  */
-int base64url_decode(char *dest, const size_t maxlen, const char *src, const size_t len, size_t *dlen);
+RB64U_API int base64url_decode(char *dest, const size_t maxlen, const char *src, const size_t len, size_t *dlen);
+
+
+/**
+ * decode only the count bytes starting at byte offset of the data encoded in
+ * src, without decoding what precedes them. every 3 decoded bytes come from
+ * exactly 4 characters, so decoding starts at the group containing offset.
+ * src must not contain anything but the encoding and optional final padding.
+ * dest must have room for count bytes.
+ *
+ * set dlen to the number of bytes written, regardless of success; this is
+ * less than count if the range runs past the end of the data.
+ * return zero on success, a negative value on failure or if offset is past
+ * the end of the data.
+ */
+RB64U_API int base64url_decode_range(char *dest, const char *src, const size_t len, const size_t offset, const size_t count, size_t *dlen);
+
+
+/**
+ * default input length at which base64url_encode() and base64url_decode()
+ * switch to the large-buffer path
+ */
+#ifndef RB64U_NT_THRESHOLD
+#define RB64U_NT_THRESHOLD (8 << 20)
+#endif
+
+
+/**
+ * large-buffer variant of base64url_encode() for inputs much larger than the
+ * last-level cache.
+ *
+ * output is written with non-temporal stores, which bypass the cache, and
+ * input is prefetched ahead of the encoder; a single fence is issued before
+ * the final group is written. this avoids evicting the working set of other
+ * threads and the reads for ownership of the output lines. on targets without
+ * SSE2 it encodes as base64url_encode() does, apart from a short buffer.
+ *
+ * base64url_encode() calls this when len is at least the threshold set by
+ * base64url_set_nt_threshold() and maxlen holds the whole result, so its
+ * partial output on a short buffer is unchanged. called directly, on any
+ * target, if maxlen is too small for the whole result, returns -1 and does no
+ * work.
+ */
+RB64U_API int base64url_encode_nt(char *dest, const size_t maxlen, const char *src, const size_t len, size_t *dlen);
+
+
+/**
+ * large-buffer variant of base64url_decode(), with the same non-temporal
+ * stores and prefetching as base64url_encode_nt(). base64url_decode() calls
+ * this when len is at least the threshold.
+ *
+ * unlike base64url_encode_nt(), it does not refuse a short buffer up front:
+ * if maxlen may be too small for the whole result, the state machine decodes
+ * with ordinary stores and, like base64url_decode(), writes what fits,
+ * stores that length in dlen and returns -1. on targets without SSE2 it is
+ * the same as base64url_decode().
+ */
+RB64U_API int base64url_decode_nt(char *dest, const size_t maxlen, const char *src, const size_t len, size_t *dlen);
+
+
+/**
+ * set the input length at which base64url_encode() and base64url_decode()
+ * switch to the large-buffer path; (size_t)-1 disables the switch. the
+ * default is RB64U_NT_THRESHOLD. not synchronized; set it before starting
+ * threads that encode or decode. with RB64U_STATIC_INLINE, each translation
+ * unit keeps its own threshold.
+ * returns the previous threshold.
+ */
+RB64U_API size_t base64url_set_nt_threshold(size_t len);
+
+
+/**
+ * flags for base64url_validate()
+ */
+#define RB64U_PAD_REQUIRED   0x01 /* input must be padded to a multiple of 4 */
+#define RB64U_PAD_FORBIDDEN  0x02 /* input must not be padded */
+#define RB64U_CANONICAL      0x04 /* unused bits of the final character must be zero */
+
+/**
+ * check that src with length len is well-formed base64url, without writing
+ * any output: every character is in the alphabet, padding appears only at the
+ * end and only as much as the final group calls for, and the final group is
+ * not a single character. flags may add further checks.
+ *
+ * on success, set decoded_len to the number of bytes base64url_decode() would
+ * produce. on failure, set err_offset to the offset of the first offending
+ * character, or len if the input ended too soon. either may be NULL.
+ *
+ * return zero if src is valid, a negative value otherwise.
+ */
+RB64U_API int base64url_validate(const char *src, const size_t len, const int flags, size_t *decoded_len, size_t *err_offset);
+
+
+/**
+ * constant-time variant of base64url_encode() for secret material.
+ *
+ * characters are computed arithmetically instead of by table lookup, and no
+ * branch depends on the input bytes, only on len. if maxlen is too small for
+ * the whole result, returns -1 and does no work.
+ *
+ * returns the same value as base64url_encode() on success, a negative value
+ * on failure.
+ */
+RB64U_API int base64url_encode_ct(char *dest, const size_t maxlen, const char *src, const size_t len, size_t *dlen);
+
+
+/**
+ * constant-time variant of base64url_decode() for secret material.
+ *
+ * characters are range-checked arithmetically instead of by table lookup, and
+ * no branch depends on the input characters, only on len and on whether the
+ * input ends in padding. unlike base64url_decode(), characters outside the
+ * base64url alphabet are rejected, as is a length that leaves a single
+ * character in the final group; the whole input is processed either way and
+ * the error is reported only at the end. if maxlen is too small for the whole
+ * result, returns -1 and does no work.
+ *
+ * set dlen to the number of bytes written, regardless of success.
+ * return zero on success, a negative value on failure.
+ */
+RB64U_API int base64url_decode_ct(char *dest, const size_t maxlen, const char *src, const size_t len, size_t *dlen);
+
+
+/**
+ * compare the decoding of src with length len against expected_len bytes of
+ * expected, without writing the decoded bytes anywhere. src is decoded and
+ * compared 8 characters at a time in registers, and the first difference ends
+ * the call, so timing reveals where it is: use this for values that are not
+ * secret, such as IDs. src must be well-formed as for base64url_validate()
+ * with no flags; padding is optional.
+ *
+ * return 1 if src decodes to exactly expected, 0 if it does not or if src is
+ * not well-formed.
+ */
+RB64U_API int base64url_decode_equals(const char *src, const size_t len, const char *expected, const size_t expected_len);
+
+
+/**
+ * constant-time variant of base64url_decode_equals() for secrets, such as MAC
+ * tags or API keys. the whole input is decoded as by base64url_decode_ct() and
+ * compared without an early exit; no branch depends on the characters of src
+ * or the bytes of expected, only on the lengths and on whether src ends in
+ * padding.
+ *
+ * returns the same values as base64url_decode_equals().
+ */
+RB64U_API int base64url_decode_equals_ct(const char *src, const size_t len, const char *expected, const size_t expected_len);
+
+
+/** decode cache *************************************************************/
+
+typedef struct b64u_cache b64u_cache_t;
+
+/**
+ * create a decode cache holding up to capacity decoded values, for encoded
+ * inputs of up to maxkey characters; longer inputs are decoded but never
+ * cached. the cache is split into shards, each with its own lock, so many
+ * threads may share it. entries are placed by a hash of the encoded input,
+ * and a new entry replaces whatever held its slot.
+ *
+ * the cache is only compiled in when the library is built with RB64U_CACHE
+ * defined (configure --enable-cache), which needs pthreads.
+ *
+ * returns NULL on failure, or always if the cache is not compiled in. in both
+ * builds the other cache functions accept NULL as no cache, so a caller that
+ * gets NULL can go on without one.
+ */
+RB64U_API b64u_cache_t *base64url_cache_create(size_t capacity, size_t maxkey);
+
+
+/**
+ * free a decode cache. no other thread may be using it.
+ */
+RB64U_API void base64url_cache_destroy(b64u_cache_t *cache);
+
+
+/**
+ * same as base64url_decode(), but first looks up src in cache and, on a hit,
+ * copies the cached result to dest. on a miss, decodes src and caches the
+ * result if decoding succeeded. a NULL cache is no cache: src is decoded
+ * every time, whether or not the cache is compiled in.
+ */
+RB64U_API int base64url_decode_cached(b64u_cache_t *cache, char *dest, const size_t maxlen, const char *src, const size_t len, size_t *dlen);
+
+
+/**
+ * read the hit and miss counters of cache, summed over its shards.
+ * either may be NULL. a NULL cache reads zero.
+ */
+RB64U_API void base64url_cache_counters(b64u_cache_t *cache, uint64_t *hits, uint64_t *misses);
 
 
 /** re-entrant methods *******************************************************/
@@ -74,7 +283,7 @@ int base64url_decode(char *dest, const size_t maxlen, const char *src, const siz
  * an encoder state object may be reset at any time, either to abandon a
  * current encoding process or to begin a new one or both.
  */
-void base64url_encode_reset(b64ue_t *state);
+RB64U_API void base64url_encode_reset(b64ue_t *state);
 
 
 /**
@@ -83,7 +292,7 @@ void base64url_encode_reset(b64ue_t *state);
  * call this method as many times as base64url_encode_ingest() tells you, and do
  * so before calling base64url_encode_ingest() again.
  */
-int base64url_encode_getc(b64ue_t *state);
+RB64U_API int base64url_encode_getc(b64ue_t *state);
 
 
 /**
@@ -95,7 +304,7 @@ int base64url_encode_getc(b64ue_t *state);
  *
  * on failure, returns a negative value.
  */
-int base64url_encode_ingest(b64ue_t *state, unsigned char c);
+RB64U_API int base64url_encode_ingest(b64ue_t *state, unsigned char c);
 
 
 /**
@@ -113,7 +322,7 @@ int base64url_encode_ingest(b64ue_t *state, unsigned char c);
  *
  * on failure, returns a negative value.
  */
-int base64url_encode_finish(b64ue_t *state);
+RB64U_API int base64url_encode_finish(b64ue_t *state);
 
 
 /**
@@ -128,7 +337,7 @@ int base64url_encode_finish(b64ue_t *state);
  *
  * on failure, returns a negative value.
  */
-int base64url_encode_pad(b64ue_t *state);
+RB64U_API int base64url_encode_pad(b64ue_t *state);
 
 
 /**
@@ -137,7 +346,7 @@ int base64url_encode_pad(b64ue_t *state);
  * a decoder state object may be reset at any time, either to abandon a
  * current decoding process or to begin a new one or both.
  */
-void base64url_decode_reset(b64ud_t *state);
+RB64U_API void base64url_decode_reset(b64ud_t *state);
 
 
 /**
@@ -146,7 +355,7 @@ void base64url_decode_reset(b64ud_t *state);
  * call this method as many times as base64url_decode_ingest() tells you, and do
  * so before calling base64url_decode_ingest() again.
  */
-int base64url_decode_getc(b64ud_t *state);
+RB64U_API int base64url_decode_getc(b64ud_t *state);
 
 
 /**
@@ -158,6 +367,84 @@ int base64url_decode_getc(b64ud_t *state);
  *
  * on failure, returns a negative value.
  */
-int base64url_decode_ingest(b64ud_t *state, unsigned char c);
+RB64U_API int base64url_decode_ingest(b64ud_t *state, unsigned char c);
+
+
+/** runtime statistics ********************************************************/
+
+/**
+ * code paths, for b64u_stats_t.path
+ */
+#define RB64U_PATH_STATE  0 /* per-character state machine */
+#define RB64U_PATH_CT     1 /* constant-time block codec */
+#define RB64U_PATH_NT     2 /* large-buffer block codec, non-temporal stores */
+#define RB64U_PATH_CACHE  3 /* decode cache hits */
+#define RB64U_PATH_MAX    4
+
+/**
+ * failure causes, for b64u_stats_t.errors
+ */
+#define RB64U_ERR_MAXLEN  0 /* output would exceed maxlen */
+#define RB64U_ERR_STATE   1 /* state vector was invalid */
+#define RB64U_ERR_ARG     2 /* invalid argument */
+#define RB64U_ERR_INPUT   3 /* malformed input */
+#define RB64U_ERR_MAX     4
+
+typedef struct b64u_stats b64u_stats_t;
+
+/**
+ * counters, summed over all threads
+ */
+struct b64u_stats
+{
+  const char *kernel;                  /* name of the codec kernel in use */
+  uint64_t encode_calls;               /* base64url_encode*() */
+  uint64_t decode_calls;               /* base64url_decode*() */
+  uint64_t ingest_calls;               /* base64url_encode_ingest(), base64url_decode_ingest() */
+  uint64_t encode_in;                  /* bytes read by the encoder */
+  uint64_t encode_out;                 /* characters produced by the encoder */
+  uint64_t decode_in;                  /* characters read by the decoder */
+  uint64_t decode_out;                 /* bytes produced by the decoder */
+  uint64_t path[RB64U_PATH_MAX];       /* bytes read, per code path */
+  uint64_t errors[RB64U_ERR_MAX];      /* failures, per cause */
+};
+
+
+/**
+ * copy the current counters into stats.
+ *
+ * counters are only collected when the library is built with RB64U_STATS
+ * defined (configure --enable-stats). each thread updates its own counters
+ * without locking; they are summed here, so values read while other threads
+ * are working are approximate. with RB64U_STATIC_INLINE, each translation unit
+ * keeps its own counters.
+ *
+ * returns zero on success. returns a negative value if statistics were not
+ * compiled in, in which case all counters are zero but the kernel name is
+ * still set.
+ */
+RB64U_API int base64url_stats_get(b64u_stats_t *stats);
+
+
+/**
+ * zero the counters of all threads.
+ */
+RB64U_API void base64url_stats_reset(void);
+
+
+/**
+ * name of a code path (RB64U_PATH_*) or failure cause (RB64U_ERR_*), or NULL
+ * if out of range.
+ */
+RB64U_API const char *base64url_stats_path_name(int path);
+RB64U_API const char *base64url_stats_error_name(int err);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef RB64U_STATIC_INLINE
+#include "librb64u_impl.h"
+#endif
 
 #endif
\ No newline at end of file
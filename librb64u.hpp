@@ -0,0 +1,283 @@
+/**
+ * re-entrant base64url, C++20 range adaptors
+ *
+ *   for (char c : bytes | rb64u::encode_view) ...
+ *   for (std::span<const char> block : (text | rb64u::decode_view).chunks()) ...
+ *
+ * the views encode or decode lazily, one block at a time, through
+ * base64url_encode() and base64url_decode(), so the full output is never
+ * materialized. blocks are a whole number of groups, so the output matches a
+ * single call over the whole input. the source may be any input range of a
+ * 1-byte type (char, unsigned char, signed char, std::byte); contiguous sized
+ * sources are read in place, anything else is copied into the view a block at
+ * a time.
+ *
+ * like std::ranges::istream_view, the views are single-pass: begin() may be
+ * called once, and iterating characters and chunks() share the same position.
+ * link with librb64u.
+ * @author jon <jon@wroth.org>
+ * CC-BY-4.0
+ */
+#ifndef LIB_RB64U_HPP
+#define LIB_RB64U_HPP
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include "librb64u.h"
+
+namespace rb64u {
+
+namespace detail {
+
+template <class T>
+concept byte_like = sizeof(T) == 1 && (std::is_integral_v<T> || std::is_same_v<T, std::byte>);
+
+template <class R>
+concept byte_range = std::ranges::input_range<R> && byte_like<std::ranges::range_value_t<R>>;
+
+/**
+ * block encoder: 3072 input bytes to 4096 characters
+ */
+struct encoder
+{
+  static constexpr std::size_t in_size = 3072;
+  static constexpr std::size_t out_size = 4096;
+
+  /* returns false if no further blocks should be read */
+  static bool run(char *dest, std::size_t *dlen, const char *src, std::size_t len)
+  {
+    base64url_encode(dest, out_size, src, len, dlen);
+    return true;
+  }
+};
+
+/**
+ * block decoder: 4096 characters to 3072 bytes. once padding is seen the
+ * state machine produces nothing more, so neither do later blocks.
+ */
+struct decoder
+{
+  static constexpr std::size_t in_size = 4096;
+  static constexpr std::size_t out_size = 3072;
+
+  static bool run(char *dest, std::size_t *dlen, const char *src, std::size_t len)
+  {
+    base64url_decode(dest, out_size, src, len, dlen);
+    return nullptr == std::memchr(src, '=', len);
+  }
+};
+
+/**
+ */
+template <std::ranges::view V, class Codec>
+  requires byte_range<V>
+class coded_view : public std::ranges::view_interface<coded_view<V, Codec>>
+{
+  static constexpr bool in_place = std::ranges::contiguous_range<V> && std::ranges::sized_range<V>;
+
+  V base_ = V();
+  std::optional<std::ranges::iterator_t<V>> it_;  /* set by start(), unless in_place */
+  std::size_t off_ = 0;      /* read position, when in_place */
+  bool started_ = false;
+  bool more_ = true;         /* false once the codec or the source is done */
+  std::size_t pos_ = 0;
+  std::size_t len_ = 0;
+  std::array<char, Codec::out_size> out_ {};
+  std::array<char, in_place ? 1 : Codec::in_size> in_ {};
+
+  /**
+   * code the next block of input into out_; len_ is zero at the end
+   */
+  void fill()
+  {
+    const char *src;
+    std::size_t n;
+
+    pos_ = len_ = 0;
+    while (0 == len_ && more_) {
+      n = 0;
+      if constexpr (in_place) {
+        n = std::ranges::size(base_) - off_;
+        if (n > Codec::in_size) n = Codec::in_size;
+        src = reinterpret_cast<const char *>(std::ranges::data(base_)) + off_;
+        off_ += n;
+      }
+      else {
+        auto end = std::ranges::end(base_);
+        auto &it = *it_;
+        for (; n < Codec::in_size && it != end; ++it)
+          in_[n++] = static_cast<char>(*it);
+        src = in_.data();
+      }
+      if (0 == n) {
+        more_ = false;
+        return;
+      }
+      more_ = Codec::run(out_.data(), &len_, src, n) && Codec::in_size == n;
+    }
+  }
+
+  void start()
+  {
+    if (started_) return;
+    started_ = true;
+    if constexpr (!in_place) it_.emplace(std::ranges::begin(base_));
+    fill();
+  }
+
+public:
+  /**
+   * input iterator over the output characters
+   */
+  class iterator
+  {
+    coded_view *v_ = nullptr;
+
+  public:
+    using iterator_concept = std::input_iterator_tag;
+    using value_type = char;
+    using difference_type = std::ptrdiff_t;
+
+    iterator() = default;
+    explicit iterator(coded_view *v) : v_(v) {}
+
+    char operator*() const { return v_->out_[v_->pos_]; }
+
+    iterator &operator++()
+    {
+      if (++v_->pos_ == v_->len_) v_->fill();
+      return *this;
+    }
+
+    void operator++(int) { ++*this; }
+
+    /**
+     * the rest of the current block
+     */
+    std::span<const char> chunk() const
+    {
+      return std::span<const char>(v_->out_.data() + v_->pos_, v_->len_ - v_->pos_);
+    }
+
+    bool operator==(std::default_sentinel_t) const
+    {
+      return v_->pos_ == v_->len_;
+    }
+  };
+
+  /**
+   * input range over whole output blocks, as contiguous spans
+   */
+  class chunk_range : public std::ranges::view_interface<chunk_range>
+  {
+    coded_view *v_ = nullptr;
+
+  public:
+    class iterator
+    {
+      coded_view *v_ = nullptr;
+
+    public:
+      using iterator_concept = std::input_iterator_tag;
+      using value_type = std::span<const char>;
+      using difference_type = std::ptrdiff_t;
+
+      iterator() = default;
+      explicit iterator(coded_view *v) : v_(v) {}
+
+      value_type operator*() const
+      {
+        return value_type(v_->out_.data() + v_->pos_, v_->len_ - v_->pos_);
+      }
+
+      iterator &operator++()
+      {
+        v_->fill();
+        return *this;
+      }
+
+      void operator++(int) { ++*this; }
+
+      bool operator==(std::default_sentinel_t) const
+      {
+        return v_->pos_ == v_->len_;
+      }
+    };
+
+    chunk_range() = default;
+    explicit chunk_range(coded_view *v) : v_(v) {}
+
+    iterator begin()
+    {
+      v_->start();
+      return iterator(v_);
+    }
+
+    std::default_sentinel_t end() const { return std::default_sentinel; }
+  };
+
+  coded_view() requires std::default_initializable<V> = default;
+  explicit coded_view(V base) : base_(std::move(base)) {}
+
+  V base() const & requires std::copy_constructible<V> { return base_; }
+  V base() && { return std::move(base_); }
+
+  iterator begin()
+  {
+    start();
+    return iterator(this);
+  }
+
+  std::default_sentinel_t end() const { return std::default_sentinel; }
+
+  chunk_range chunks() { return chunk_range(this); }
+};
+
+/**
+ * range adaptor object: r | adaptor, or adaptor(r)
+ */
+template <class Codec>
+struct adaptor
+{
+  template <std::ranges::viewable_range R>
+    requires byte_range<std::views::all_t<R>>
+  auto operator()(R &&r) const
+  {
+    return coded_view<std::views::all_t<R>, Codec>(std::views::all(std::forward<R>(r)));
+  }
+
+  template <std::ranges::viewable_range R>
+    requires byte_range<std::views::all_t<R>>
+  friend auto operator|(R &&r, const adaptor &a)
+  {
+    return a(std::forward<R>(r));
+  }
+};
+
+} /* namespace detail */
+
+/**
+ * lazy base64url encoding of a byte range, without padding
+ */
+template <std::ranges::view V>
+using encoded_view = detail::coded_view<V, detail::encoder>;
+
+/**
+ * lazy base64url decoding of a character range; padding is handled as by
+ * base64url_decode()
+ */
+template <std::ranges::view V>
+using decoded_view = detail::coded_view<V, detail::decoder>;
+
+inline constexpr detail::adaptor<detail::encoder> encode_view {};
+inline constexpr detail::adaptor<detail::decoder> decode_view {};
+
+} /* namespace rb64u */
+
+#endif
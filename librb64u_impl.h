@@ -0,0 +1,1340 @@
+/**
+ * re-entrant base64url, implementation
+ *
+ * compiled once into the library by librb64u.c, or included by librb64u.h in
+ * every translation unit that defines RB64U_STATIC_INLINE.
+ * @author jon <jon@wroth.org>
+ * CC-BY-4.0
+ */
+#ifndef LIB_RB64U_IMPL_H
+#define LIB_RB64U_IMPL_H
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "librb64u.h"
+#if defined(RB64U_STATS) || defined(RB64U_CACHE)
+#include <pthread.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#define RB64U_HAVE_NT 1
+#endif
+
+/**
+ * encoder table
+ */
+static const unsigned char base64url_etab[64] =
+{
+  'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H',
+  'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P',
+  'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X',
+  'Y', 'Z', 'a', 'b', 'c', 'd', 'e', 'f',
+  'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n',
+  'o', 'p', 'q', 'r', 's', 't', 'u', 'v',
+  'w', 'x', 'y', 'z', '0', '1', '2', '3',
+  '4', '5', '6', '7', '8', '9', '-', '_'};
+
+/**
+ * decoder table
+ */
+static const unsigned char base64url_dtab[256] = {
+  '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00',
+  '\x01', '\x00', '\x00', '\x00', '\x5c', '\x08', '\x00', '\x00', '\xc0', '\x99', '\x76', '\xb7', '\xe0', '\x96', '\x76', '\xb7',
+  '\x45', '\x82', '\x04', '\x08', '\x8c', '\x1a', '\x61', '\xb7', '\xc8', '\x81', '\x04', '\x08', '\x01', '\x3e', '\x00', '\x00',
+  '\x34', '\x35', '\x36', '\x37', '\x38', '\x39', '\x3a', '\x3b', '\x3c', '\x3d', '\x78', '\xb7', '\xe0', '\xe3', '\xff', '\xbf',
+  '\xcf', '\x00', '\x01', '\x02', '\x03', '\x04', '\x05', '\x06', '\x07', '\x08', '\x09', '\x0a', '\x0b', '\x0c', '\x0d', '\x0e',
+  '\x0f', '\x10', '\x11', '\x12', '\x13', '\x14', '\x15', '\x16', '\x17', '\x18', '\x19', '\xb7', '\x01', '\x00', '\x00', '\x3f',
+  '\x00', '\x1a', '\x1b', '\x1c', '\x1d', '\x1e', '\x1f', '\x20', '\x21', '\x22', '\x23', '\x24', '\x25', '\x26', '\x27', '\x28',
+  '\x29', '\x2a', '\x2b', '\x2c', '\x2d', '\x2e', '\x2f', '\x30', '\x31', '\x32', '\x33', '\x00', '\x00', '\x00', '\x00', '\x00',
+  '\xd0', '\xe3', '\xff', '\xbf', '\xc4', '\xe3', '\xff', '\xbf', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00',
+  '\x00', '\x00', '\x00', '\x00', '\x10', '\xe4', '\xff', '\xbf', '\x68', '\x66', '\x78', '\xb7', '\x45', '\x82', '\x04', '\x08',
+  '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00',
+  '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00',
+  '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00',
+  '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00',
+  '\x66', '\xf5', '\xff', '\xbf', '\x1e', '\x31', '\x67', '\xb7', '\x79', '\x0b', '\x72', '\xb7', '\xbc', '\x96', '\x04', '\x08',
+  '\xb8', '\xe3', '\xff', '\xbf', '\xec', '\x82', '\x04', '\x08', '\xf4', '\xbf', '\x75', '\xb7', '\xbc', '\x96', '\x04', '\x08'};
+
+
+/**
+ * name of the codec kernel, reported by base64url_stats_get()
+ */
+static const char *b64u_kernel = "scalar";
+
+static const char *b64u_path_names[RB64U_PATH_MAX] = { "state", "ct", "nt", "cache" };
+static const char *b64u_error_names[RB64U_ERR_MAX] = { "maxlen", "state", "arg", "input" };
+
+/**
+ * characters per block in the constant-time decoder; a multiple of 4
+ */
+#define RB64U_CT_BLOCK 64
+
+/**
+ * decode cache shards; a power of 2
+ */
+#define RB64U_CACHE_SHARDS 16
+
+/**
+ * input bytes per chunk of the large-buffer encoder, and characters per chunk
+ * of the large-buffer decoder. chunks are staged in a buffer that stays in L1
+ * and then streamed out.
+ */
+#define RB64U_NT_ECHUNK 3072
+#define RB64U_NT_DCHUNK 4096
+
+/**
+ * input length at which base64url_encode() and base64url_decode() switch to
+ * the large-buffer path, see base64url_set_nt_threshold()
+ */
+static size_t b64u_nt_threshold = RB64U_NT_THRESHOLD;
+
+#ifdef RB64U_STATS
+/**
+ * per-thread counters. each thread allocates its block on first use and links
+ * it into a global list so readers can sum them; only registration, thread exit
+ * and reads take the lock. counters of exited threads are folded into
+ * b64u_stats_retired.
+ */
+struct b64u_tls
+{
+  b64u_stats_t s;
+  struct b64u_tls *prev;
+  struct b64u_tls *next;
+};
+
+static pthread_mutex_t b64u_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t b64u_stats_once = PTHREAD_ONCE_INIT;
+static pthread_key_t b64u_stats_key;
+static struct b64u_tls *b64u_stats_list = NULL;
+static b64u_stats_t b64u_stats_retired;
+static __thread struct b64u_tls *b64u_stats_self = NULL;
+
+/**
+ * add counters b into a
+ */
+static void b64u_stats_sum(b64u_stats_t *a, const b64u_stats_t *b)
+{
+  int i;
+  a->encode_calls += b->encode_calls;
+  a->decode_calls += b->decode_calls;
+  a->ingest_calls += b->ingest_calls;
+  a->encode_in += b->encode_in;
+  a->encode_out += b->encode_out;
+  a->decode_in += b->decode_in;
+  a->decode_out += b->decode_out;
+  for (i = 0; i < RB64U_PATH_MAX; i++) a->path[i] += b->path[i];
+  for (i = 0; i < RB64U_ERR_MAX; i++) a->errors[i] += b->errors[i];
+}
+
+/**
+ * thread exit: fold counters into b64u_stats_retired and release the block
+ */
+static void b64u_stats_release(void *p)
+{
+  struct b64u_tls *t = p;
+  pthread_mutex_lock(&b64u_stats_lock);
+  b64u_stats_sum(&b64u_stats_retired, &t->s);
+  if (NULL != t->prev) t->prev->next = t->next;
+  else b64u_stats_list = t->next;
+  if (NULL != t->next) t->next->prev = t->prev;
+  pthread_mutex_unlock(&b64u_stats_lock);
+  free(t);
+}
+
+/**
+ */
+static void b64u_stats_init(void)
+{
+  pthread_key_create(&b64u_stats_key, b64u_stats_release);
+}
+
+/**
+ * allocate and register the calling thread's counters.
+ * returns NULL if no memory is available, in which case nothing is counted.
+ */
+static struct b64u_tls *b64u_stats_register(void)
+{
+  struct b64u_tls *t;
+  pthread_once(&b64u_stats_once, b64u_stats_init);
+  t = calloc(1, sizeof(*t));
+  if (NULL == t) return NULL;
+  pthread_mutex_lock(&b64u_stats_lock);
+  t->next = b64u_stats_list;
+  if (NULL != b64u_stats_list) b64u_stats_list->prev = t;
+  b64u_stats_list = t;
+  pthread_mutex_unlock(&b64u_stats_lock);
+  pthread_setspecific(b64u_stats_key, t);
+  b64u_stats_self = t;
+  return t;
+}
+
+#define RB64U_STAT_ADD(field, v) do { \
+    struct b64u_tls *t_ = (NULL != b64u_stats_self) ? b64u_stats_self : b64u_stats_register(); \
+    if (NULL != t_) t_->s.field += (v); \
+  } while (0)
+#else
+#define RB64U_STAT_ADD(field, v) do { } while (0)
+#endif
+
+static int  b64u_encode_ingest(b64ue_t *state, unsigned char c);
+static int  b64u_encode_finish(b64ue_t *state);
+static int  b64u_decode_ingest(b64ud_t *state, unsigned char c);
+
+
+/**
+ */
+RB64U_API int base64url_encode(char *dest, const size_t maxlen, const char *src, const size_t len, size_t *dlen)
+{
+  int r;
+  size_t i, dsz = 0;
+  b64ue_t s;
+#ifdef RB64U_HAVE_NT
+  /* the large-buffer path writes nothing on a short buffer; this writes what fits */
+  if (len >= b64u_nt_threshold && maxlen >= len / 3 * 4 + ((len % 3) ? len % 3 + 1 : 0))
+    return base64url_encode_nt(dest, maxlen, src, len, dlen);
+#endif
+  if (NULL != dlen) *dlen = 0;
+  RB64U_STAT_ADD(encode_calls, 1);
+  base64url_encode_reset(&s);
+  for (i = 0; i < len; i++)
+  {
+    r = b64u_encode_ingest(&s, src[i]);
+    if (r < 0) {
+      RB64U_STAT_ADD(errors[RB64U_ERR_STATE], 1);
+      goto fail;
+    }
+    while (r > 0) {
+      if (maxlen <= dsz) {
+        RB64U_STAT_ADD(errors[RB64U_ERR_MAXLEN], 1);
+        goto fail;
+      }
+      dest[dsz++] = base64url_encode_getc(&s);
+      r--;
+    }
+  }
+  r = b64u_encode_finish(&s);
+  if (r < 0) {
+    RB64U_STAT_ADD(errors[RB64U_ERR_STATE], 1);
+    goto fail;
+  }
+  while (r > 0) {
+    if (maxlen <= dsz) {
+      RB64U_STAT_ADD(errors[RB64U_ERR_MAXLEN], 1);
+      goto fail;
+    }
+    dest[dsz++] = base64url_encode_getc(&s);
+    r--;
+  }
+  RB64U_STAT_ADD(encode_in, i);
+  RB64U_STAT_ADD(encode_out, dsz);
+  RB64U_STAT_ADD(path[RB64U_PATH_STATE], i);
+  if (NULL != dlen) *dlen = dsz;
+  return s.n;
+
+fail:
+  RB64U_STAT_ADD(encode_in, i);
+  RB64U_STAT_ADD(encode_out, dsz);
+  RB64U_STAT_ADD(path[RB64U_PATH_STATE], i);
+  if (NULL != dlen) *dlen = dsz;
+  return -1;
+}
+
+/**
+ */
+RB64U_API int base64url_encode_padded(char *dest, const size_t maxlen, const char *src, const size_t len, size_t *dlen)
+{
+  size_t tlen;
+  int r;
+  if (maxlen < 2) {
+    RB64U_STAT_ADD(errors[RB64U_ERR_ARG], 1);
+    return -1;
+  }
+  r = base64url_encode(dest, maxlen-2, src, len, &tlen);
+  if (NULL != dlen) *dlen = tlen;
+  if (r < 0) return r;
+  if (r > 0) {
+    dest[tlen++] = '=';
+    if (r < 2)
+      dest[tlen++] = '=';
+    RB64U_STAT_ADD(encode_out, 3 - r);
+  }
+  if (NULL != dlen) *dlen = tlen;
+  return 0;
+}
+
+/**
+ */
+RB64U_API int base64url_decode(char *dest, const size_t maxlen, const char *src, const size_t len, size_t *dlen)
+{
+  int r;
+  size_t i, dsz = 0;
+  b64ud_t s;
+#ifdef RB64U_HAVE_NT
+  if (len >= b64u_nt_threshold)
+    return base64url_decode_nt(dest, maxlen, src, len, dlen);
+#endif
+  if (NULL != dlen) *dlen = 0;
+  RB64U_STAT_ADD(decode_calls, 1);
+  base64url_decode_reset(&s);
+  for (i = 0; i < len; i++)
+  {
+    r = b64u_decode_ingest(&s, src[i]);
+    if (r < 0) {
+      RB64U_STAT_ADD(errors[RB64U_ERR_STATE], 1);
+      goto fail;
+    }
+    if (r > 0) {
+      if (maxlen <= dsz) {
+        RB64U_STAT_ADD(errors[RB64U_ERR_MAXLEN], 1);
+        goto fail;
+      }
+      dest[dsz++] = base64url_decode_getc(&s);
+    }
+  }
+  RB64U_STAT_ADD(decode_in, i);
+  RB64U_STAT_ADD(decode_out, dsz);
+  RB64U_STAT_ADD(path[RB64U_PATH_STATE], i);
+  if (NULL != dlen) *dlen = dsz;
+  return 0;
+
+fail:
+  RB64U_STAT_ADD(decode_in, i);
+  RB64U_STAT_ADD(decode_out, dsz);
+  RB64U_STAT_ADD(path[RB64U_PATH_STATE], i);
+  if (NULL != dlen) *dlen = dsz;
+  return -1;
+}
+
+/**
+ */
+RB64U_API int base64url_decode_range(char *dest, const char *src, const size_t len, const size_t offset, const size_t count, size_t *dlen)
+{
+  int r;
+  size_t i, end, n = len, skip = offset % 3, total, want, dsz = 0;
+  b64ud_t s;
+
+  if (NULL != dlen) *dlen = 0;
+  RB64U_STAT_ADD(decode_calls, 1);
+
+  /* decoded length, less padding */
+  if (n > 0 && '=' == src[n-1]) n--;
+  if (n > 0 && '=' == src[n-1]) n--;
+  total = n / 4 * 3 + ((n % 4) ? n % 4 - 1 : 0);
+  if (offset > total) {
+    RB64U_STAT_ADD(errors[RB64U_ERR_ARG], 1);
+    return -1;
+  }
+
+  /* count may run past the end, up to (size_t)-1; clamp it before it can
+   * overflow the group arithmetic */
+  want = (count < total - offset) ? count : total - offset;
+
+  /* the group holding offset, through the group holding the last byte */
+  i = offset / 3 * 4;
+  end = i + (skip + want + 2) / 3 * 4;
+  if (end > n) end = n;
+
+  base64url_decode_reset(&s);
+  for (; i < end && dsz < want; i++)
+  {
+    r = b64u_decode_ingest(&s, src[i]);
+    if (r < 0) {
+      RB64U_STAT_ADD(errors[RB64U_ERR_STATE], 1);
+      break;
+    }
+    if (r > 0) {
+      r = base64url_decode_getc(&s);
+      if (skip > 0) skip--;
+      else dest[dsz++] = r;
+    }
+  }
+  RB64U_STAT_ADD(decode_in, i - offset / 3 * 4);
+  RB64U_STAT_ADD(decode_out, dsz);
+  RB64U_STAT_ADD(path[RB64U_PATH_STATE], i - offset / 3 * 4);
+  if (NULL != dlen) *dlen = dsz;
+  return (i < end && dsz < want) ? -1 : 0;
+}
+
+
+/* large-buffer methods *******************************************************/
+
+#ifdef RB64U_HAVE_NT
+/**
+ * encode n bytes of p, a multiple of 3, into d
+ */
+static void b64u_encode_block(unsigned char *d, const unsigned char *p, size_t n)
+{
+  size_t i;
+  for (i = 0; i + 3 <= n; i += 3) {
+    *d++ = base64url_etab[p[i] >> 2];
+    *d++ = base64url_etab[((p[i] & 0x03) << 4) | (p[i+1] >> 4)];
+    *d++ = base64url_etab[((p[i+1] & 0x0f) << 2) | (p[i+2] >> 6)];
+    *d++ = base64url_etab[p[i+2] & 0x3f];
+  }
+}
+
+/**
+ * decode whole groups of n characters of p, a multiple of 4, into d, as the
+ * state machine would. stops before the first group holding padding.
+ * returns the number of characters consumed.
+ */
+static size_t b64u_decode_block(unsigned char *d, const unsigned char *p, size_t n)
+{
+  unsigned char a, b, c, e;
+  size_t i;
+  for (i = 0; i + 4 <= n; i += 4) {
+    if ('=' == p[i] || '=' == p[i+1] || '=' == p[i+2] || '=' == p[i+3])
+      break;
+    a = base64url_dtab[p[i]] & 0x3f;
+    b = base64url_dtab[p[i+1]] & 0x3f;
+    c = base64url_dtab[p[i+2]] & 0x3f;
+    e = base64url_dtab[p[i+3]] & 0x3f;
+    *d++ = (a << 2) | (b >> 4);
+    *d++ = (b << 4) | (c >> 2);
+    *d++ = (c << 6) | e;
+  }
+  return i;
+}
+
+/**
+ * copy n bytes from s to d, using non-temporal stores for every aligned
+ * 16-byte line of d. the caller fences.
+ */
+static void b64u_nt_copy(unsigned char *d, const unsigned char *s, size_t n)
+{
+  size_t k = (16 - ((uintptr_t)d & 15)) & 15;
+  if (k > n) k = n;
+  memcpy(d, s, k);
+  for (; k + 16 <= n; k += 16)
+    _mm_stream_si128((__m128i *)(d + k), _mm_loadu_si128((const __m128i *)(s + k)));
+  memcpy(d + k, s + k, n - k);
+}
+
+/**
+ * prefetch n bytes from p without allocating in the outer cache levels
+ */
+static void b64u_nt_prefetch(const unsigned char *p, size_t n)
+{
+  size_t k;
+  for (k = 0; k < n; k += 64)
+    _mm_prefetch((const char *)p + k, _MM_HINT_NTA);
+}
+#endif
+
+/**
+ */
+RB64U_API size_t base64url_set_nt_threshold(size_t len)
+{
+  size_t t = b64u_nt_threshold;
+  b64u_nt_threshold = len;
+  return t;
+}
+
+/**
+ * whole groups are encoded a chunk at a time into a staging buffer and
+ * streamed to dest, while the next chunk is prefetched. the final partial
+ * group goes through the state machine.
+ */
+RB64U_API int base64url_encode_nt(char *dest, const size_t maxlen, const char *src, const size_t len, size_t *dlen)
+{
+#ifdef RB64U_HAVE_NT
+  union { __m128i v[RB64U_NT_DCHUNK / 16]; unsigned char b[RB64U_NT_DCHUNK]; } buf;
+  const unsigned char *p = (const unsigned char *)src;
+  size_t i, m, dsz = 0, tail = len % 3, bulk = len - tail;
+  b64ue_t s;
+  int r;
+#endif
+
+  /* on every target, a short buffer gets no output */
+  if (maxlen < len / 3 * 4 + ((len % 3) ? len % 3 + 1 : 0)) {
+    if (NULL != dlen) *dlen = 0;
+    RB64U_STAT_ADD(encode_calls, 1);
+    RB64U_STAT_ADD(errors[RB64U_ERR_MAXLEN], 1);
+    return -1;
+  }
+
+#ifdef RB64U_HAVE_NT
+  if (NULL != dlen) *dlen = 0;
+  RB64U_STAT_ADD(encode_calls, 1);
+
+  for (i = 0; i < bulk; i += m) {
+    m = bulk - i;
+    if (m > RB64U_NT_ECHUNK) m = RB64U_NT_ECHUNK;
+    b64u_nt_prefetch(p + i + m, (bulk - i - m < RB64U_NT_ECHUNK) ? bulk - i - m : RB64U_NT_ECHUNK);
+    b64u_encode_block(buf.b, p + i, m);
+    b64u_nt_copy((unsigned char *)dest + dsz, buf.b, m / 3 * 4);
+    dsz += m / 3 * 4;
+  }
+  _mm_sfence();
+  RB64U_STAT_ADD(path[RB64U_PATH_NT], bulk);
+
+  base64url_encode_reset(&s);
+  for (; i < len; i++) {
+    r = b64u_encode_ingest(&s, p[i]);
+    while (r-- > 0) dest[dsz++] = base64url_encode_getc(&s);
+  }
+  r = b64u_encode_finish(&s);
+  while (r-- > 0) dest[dsz++] = base64url_encode_getc(&s);
+  RB64U_STAT_ADD(path[RB64U_PATH_STATE], tail);
+  RB64U_STAT_ADD(encode_in, len);
+  RB64U_STAT_ADD(encode_out, dsz);
+  if (NULL != dlen) *dlen = dsz;
+  return (int)tail;
+#else
+  return base64url_encode(dest, maxlen, src, len, dlen);
+#endif
+}
+
+/**
+ * whole groups are decoded a chunk at a time into a staging buffer and
+ * streamed to dest, while the next chunk is prefetched. from the first group
+ * holding padding, or if maxlen may be too small, the state machine takes
+ * over with ordinary stores.
+ */
+RB64U_API int base64url_decode_nt(char *dest, const size_t maxlen, const char *src, const size_t len, size_t *dlen)
+{
+#ifdef RB64U_HAVE_NT
+  union { __m128i v[RB64U_NT_ECHUNK / 16]; unsigned char b[RB64U_NT_ECHUNK]; } buf;
+  const unsigned char *p = (const unsigned char *)src;
+  size_t i = 0, c, m, n = len, dsz = 0, bulk;
+  b64ud_t s;
+  int r;
+
+  if (NULL != dlen) *dlen = 0;
+  RB64U_STAT_ADD(decode_calls, 1);
+
+  if (n > 0 && '=' == p[n-1]) n--;
+  if (n > 0 && '=' == p[n-1]) n--;
+  bulk = (maxlen >= n / 4 * 3 + ((n % 4) ? n % 4 - 1 : 0)) ? len - len % 4 : 0;
+
+  while (i < bulk) {
+    m = bulk - i;
+    if (m > RB64U_NT_DCHUNK) m = RB64U_NT_DCHUNK;
+    b64u_nt_prefetch(p + i + m, (bulk - i - m < RB64U_NT_DCHUNK) ? bulk - i - m : RB64U_NT_DCHUNK);
+    c = b64u_decode_block(buf.b, p + i, m);
+    b64u_nt_copy((unsigned char *)dest + dsz, buf.b, c / 4 * 3);
+    dsz += c / 4 * 3;
+    i += c;
+    if (c < m) break;
+  }
+  _mm_sfence();
+  RB64U_STAT_ADD(path[RB64U_PATH_NT], i);
+  RB64U_STAT_ADD(path[RB64U_PATH_STATE], len - i);
+
+  base64url_decode_reset(&s);
+  for (; i < len; i++) {
+    r = b64u_decode_ingest(&s, p[i]);
+    if (r > 0) {
+      if (maxlen <= dsz) {
+        RB64U_STAT_ADD(errors[RB64U_ERR_MAXLEN], 1);
+        RB64U_STAT_ADD(decode_in, i);
+        RB64U_STAT_ADD(decode_out, dsz);
+        if (NULL != dlen) *dlen = dsz;
+        return -1;
+      }
+      dest[dsz++] = base64url_decode_getc(&s);
+    }
+  }
+  RB64U_STAT_ADD(decode_in, len);
+  RB64U_STAT_ADD(decode_out, dsz);
+  if (NULL != dlen) *dlen = dsz;
+  return 0;
+#else
+  return base64url_decode(dest, maxlen, src, len, dlen);
+#endif
+}
+
+
+/* constant-time methods ******************************************************/
+
+/**
+ * base64url character for sextet v, without branches or table lookups.
+ * each term adds the distance to the next alphabet range once v reaches it.
+ * relies on arithmetic right shift of negative ints.
+ */
+static int b64u_ct_enc(int v)
+{
+  int d = 'A';
+  d += ((25 - v) >> 8) & 6;   /* a-z */
+  d -= ((51 - v) >> 8) & 75;  /* 0-9 */
+  d -= ((61 - v) >> 8) & 13;  /* - */
+  d += ((62 - v) >> 8) & 49;  /* _ */
+  return v + d;
+}
+
+/**
+ * sextet value of base64url character c, or -1, without branches or table
+ * lookups. ((lo - c) & (c - hi)) is negative only for lo < c < hi, so each
+ * term contributes only when c is in its range.
+ */
+static int b64u_ct_dec(int c)
+{
+  int r = -1;
+  r += (((64 - c) & (c - 91)) >> 8) & (c - 64);   /* A-Z */
+  r += (((96 - c) & (c - 123)) >> 8) & (c - 70);  /* a-z */
+  r += (((47 - c) & (c - 58)) >> 8) & (c + 5);    /* 0-9 */
+  r += (((44 - c) & (c - 46)) >> 8) & 63;         /* - */
+  r += (((94 - c) & (c - 96)) >> 8) & 64;         /* _ */
+  return r;
+}
+
+/**
+ * 1 if bytes a and b are equal, otherwise 0, without branches
+ */
+static size_t b64u_ct_eq(unsigned char a, unsigned char b)
+{
+  return (size_t)(((uint32_t)(a ^ b) - 1) >> 31);
+}
+
+/**
+ * the byte b repeated in each byte of a 64-bit word
+ */
+#define RB64U_SWAR(b) ((uint64_t)(b) * (((uint64_t)0x01010101 << 32) | 0x01010101))
+
+/**
+ * 1 if all 8 characters packed in w are in the base64url alphabet, without
+ * branches. for 7-bit bytes, x + (0x80 - lo) sets the top bit only if x >= lo,
+ * and x + (0x7f - hi) only if x > hi, and neither carries into the next byte.
+ */
+static int b64u_swar_valid(uint64_t w)
+{
+  uint64_t x = w & RB64U_SWAR(0x7f), ok;
+  ok  = (x + RB64U_SWAR(0x80 - 'A')) & ~(x + RB64U_SWAR(0x7f - 'Z'));
+  ok |= (x + RB64U_SWAR(0x80 - 'a')) & ~(x + RB64U_SWAR(0x7f - 'z'));
+  ok |= (x + RB64U_SWAR(0x80 - '0')) & ~(x + RB64U_SWAR(0x7f - '9'));
+  ok |= (x + RB64U_SWAR(0x80 - '-')) & ~(x + RB64U_SWAR(0x7f - '-'));
+  ok |= (x + RB64U_SWAR(0x80 - '_')) & ~(x + RB64U_SWAR(0x7f - '_'));
+  return RB64U_SWAR(0x80) == (ok & ~w & RB64U_SWAR(0x80));
+}
+
+/**
+ * the alphabet is checked 8 characters at a time with b64u_swar_valid(); from the
+ * first word that fails, if any, characters are checked one at a time to find
+ * the offset. this function is not itself constant-time.
+ */
+RB64U_API int base64url_validate(const char *src, const size_t len, const int flags, size_t *decoded_len, size_t *err_offset)
+{
+  const unsigned char *p = (const unsigned char *)src;
+  size_t i, n = len, pad, at;
+  uint64_t w;
+
+  if (NULL != decoded_len) *decoded_len = 0;
+  if (NULL != err_offset) *err_offset = len;
+
+  while (n > 0 && '=' == p[n-1] && len - n < 2) n--;
+  pad = len - n;
+
+  for (i = 0; i + 8 <= n; i += 8) {
+    memcpy(&w, p + i, 8);
+    if (!b64u_swar_valid(w)) break;
+  }
+  for (; i < n; i++) {
+    if (b64u_ct_dec(p[i]) < 0) {
+      at = i;
+      goto fail;
+    }
+  }
+
+  at = n;
+  if (pad > 0 && ((flags & RB64U_PAD_FORBIDDEN) || 0 != len % 4 || pad != 4 - n % 4))
+    goto fail;
+  at = len;
+  if (0 == pad && (flags & RB64U_PAD_REQUIRED) && 0 != n % 4)
+    goto fail;
+  at = n - 1;
+  if (1 == n % 4)
+    goto fail;
+  if ((flags & RB64U_CANONICAL) && 0 != n % 4
+   && (b64u_ct_dec(p[n-1]) & ((2 == n % 4) ? 0x0f : 0x03)))
+    goto fail;
+
+  if (NULL != decoded_len) *decoded_len = n / 4 * 3 + ((n % 4) ? n % 4 - 1 : 0);
+  return 0;
+
+fail:
+  RB64U_STAT_ADD(errors[RB64U_ERR_INPUT], 1);
+  if (NULL != err_offset) *err_offset = at;
+  return -1;
+}
+
+/**
+ */
+RB64U_API int base64url_encode_ct(char *dest, const size_t maxlen, const char *src, const size_t len, size_t *dlen)
+{
+  const unsigned char *p = (const unsigned char *)src;
+  size_t i, dsz = 0, tail = len % 3;
+  size_t need = len / 3 * 4 + (tail ? tail + 1 : 0);
+
+  if (NULL != dlen) *dlen = 0;
+  RB64U_STAT_ADD(encode_calls, 1);
+  if (maxlen < need) {
+    RB64U_STAT_ADD(errors[RB64U_ERR_MAXLEN], 1);
+    return -1;
+  }
+  for (i = 0; i + 3 <= len; i += 3) {
+    dest[dsz++] = b64u_ct_enc(p[i] >> 2);
+    dest[dsz++] = b64u_ct_enc(((p[i] & 0x03) << 4) | (p[i+1] >> 4));
+    dest[dsz++] = b64u_ct_enc(((p[i+1] & 0x0f) << 2) | (p[i+2] >> 6));
+    dest[dsz++] = b64u_ct_enc(p[i+2] & 0x3f);
+  }
+  if (tail) {
+    dest[dsz++] = b64u_ct_enc(p[i] >> 2);
+    if (1 == tail)
+      dest[dsz++] = b64u_ct_enc((p[i] & 0x03) << 4);
+    else {
+      dest[dsz++] = b64u_ct_enc(((p[i] & 0x03) << 4) | (p[i+1] >> 4));
+      dest[dsz++] = b64u_ct_enc((p[i+1] & 0x0f) << 2);
+    }
+  }
+  RB64U_STAT_ADD(encode_in, len);
+  RB64U_STAT_ADD(encode_out, dsz);
+  RB64U_STAT_ADD(path[RB64U_PATH_CT], len);
+  if (NULL != dlen) *dlen = dsz;
+  return (int)tail;
+}
+
+/**
+ * the input is mapped to sextets one block at a time, then packed. both loops
+ * are free of branches on the data, and the mapping loop is written so the
+ * compiler can vectorize it once b64u_ct_dec() is inlined. GCC 12 on x86-64
+ * does at -O3; at -O2 it only inlines b64u_ct_dec() while it has few callers.
+ */
+RB64U_API int base64url_decode_ct(char *dest, const size_t maxlen, const char *src, const size_t len, size_t *dlen)
+{
+  const unsigned char *p = (const unsigned char *)src;
+  unsigned char v[RB64U_CT_BLOCK];
+  size_t i, j, m, n = len, dsz = 0, need;
+  int x, err = 0;
+
+  if (NULL != dlen) *dlen = 0;
+  RB64U_STAT_ADD(decode_calls, 1);
+
+  /* padding can only follow a whole number of groups */
+  if (len >= 4 && 0 == len % 4) {
+    i = b64u_ct_eq(p[len-1], '=');
+    n = len - i - (i & b64u_ct_eq(p[len-2], '='));
+  }
+  if (1 == n % 4) err = -1;
+  need = n / 4 * 3 + ((n % 4) ? n % 4 - 1 : 0);
+  if (maxlen < need) {
+    RB64U_STAT_ADD(errors[RB64U_ERR_MAXLEN], 1);
+    return -1;
+  }
+
+  for (i = 0; i < n; i += m) {
+    m = n - i;
+    if (m > RB64U_CT_BLOCK) m = RB64U_CT_BLOCK;
+    /* whole blocks keep the trip count fixed, for the vectorizer */
+    if (m < RB64U_CT_BLOCK) memset(v, 'A', RB64U_CT_BLOCK);
+    memcpy(v, p + i, m);
+    for (j = 0; j < RB64U_CT_BLOCK; j++) {
+      x = b64u_ct_dec(v[j]);
+      err |= x;
+      v[j] = (unsigned char)x;
+    }
+    for (j = 0; j + 4 <= m; j += 4) {
+      dest[dsz++] = (v[j] << 2) | ((v[j+1] >> 4) & 0x03);
+      dest[dsz++] = (v[j+1] << 4) | ((v[j+2] >> 2) & 0x0f);
+      dest[dsz++] = (v[j+2] << 6) | (v[j+3] & 0x3f);
+    }
+    /* final partial group, only in the last block */
+    if (m - j >= 2)
+      dest[dsz++] = (v[j] << 2) | ((v[j+1] >> 4) & 0x03);
+    if (m - j == 3)
+      dest[dsz++] = (v[j+1] << 4) | ((v[j+2] >> 2) & 0x0f);
+  }
+
+  RB64U_STAT_ADD(decode_in, len);
+  RB64U_STAT_ADD(decode_out, dsz);
+  RB64U_STAT_ADD(path[RB64U_PATH_CT], len);
+  if (NULL != dlen) *dlen = dsz;
+  if (err < 0) {
+    RB64U_STAT_ADD(errors[RB64U_ERR_INPUT], 1);
+    return -1;
+  }
+  return 0;
+}
+
+
+/**
+ * each 8-character word is checked with b64u_swar_valid(), and its 48 decoded
+ * bits are compared with the next 6 expected bytes as one 64-bit word. the
+ * final partial word is done a group at a time. this function is not itself
+ * constant-time.
+ */
+RB64U_API int base64url_decode_equals(const char *src, const size_t len, const char *expected, const size_t expected_len)
+{
+  const unsigned char *p = (const unsigned char *)src;
+  const unsigned char *e = (const unsigned char *)expected;
+  size_t i, j, m, k = 0, n = len;
+  uint64_t w, v, x;
+  int a;
+
+  RB64U_STAT_ADD(decode_calls, 1);
+  RB64U_STAT_ADD(decode_in, len);
+
+  /* padding can only follow a whole number of groups */
+  if (len >= 4 && 0 == len % 4)
+    while (n > len - 2 && '=' == p[n-1]) n--;
+  if (1 == n % 4 || expected_len != n / 4 * 3 + ((n % 4) ? n % 4 - 1 : 0))
+    return 0;
+
+  for (i = 0; i + 8 <= n; i += 8) {
+    memcpy(&w, p + i, 8);
+    if (!b64u_swar_valid(w))
+      return 0;
+    v = x = 0;
+    for (j = 0; j < 8; j++)
+      v = (v << 6) | (base64url_dtab[p[i+j]] & 0x3f);
+    for (j = 0; j < 6; j++)
+      x = (x << 8) | e[k++];
+    if (v != x)
+      return 0;
+  }
+  for (; i < n; i += m) {
+    m = (n - i < 4) ? n - i : 4;
+    v = 0;
+    for (j = 0; j < 4; j++) {
+      a = (j < m) ? b64u_ct_dec(p[i+j]) : 0;
+      if (a < 0)
+        return 0;
+      v = (v << 6) | (uint64_t)a;
+    }
+    for (j = 0; j + 1 < m; j++)
+      if (((v >> (16 - 8 * j)) & 0xff) != e[k++])
+        return 0;
+  }
+  return 1;
+}
+
+/**
+ * as base64url_decode_ct(), a block is mapped to sextets, then each group is
+ * packed and XORed with the expected bytes into one accumulator. errors and
+ * differences are combined only after the last block.
+ */
+RB64U_API int base64url_decode_equals_ct(const char *src, const size_t len, const char *expected, const size_t expected_len)
+{
+  const unsigned char *p = (const unsigned char *)src;
+  const unsigned char *e = (const unsigned char *)expected;
+  unsigned char v[RB64U_CT_BLOCK];
+  size_t i, j, m, k = 0, n = len;
+  uint32_t diff = 0;
+  int x, err = 0;
+
+  RB64U_STAT_ADD(decode_calls, 1);
+  RB64U_STAT_ADD(decode_in, len);
+  RB64U_STAT_ADD(path[RB64U_PATH_CT], len);
+
+  if (len >= 4 && 0 == len % 4) {
+    i = b64u_ct_eq(p[len-1], '=');
+    n = len - i - (i & b64u_ct_eq(p[len-2], '='));
+  }
+  /* the lengths are not secret */
+  if (1 == n % 4 || expected_len != n / 4 * 3 + ((n % 4) ? n % 4 - 1 : 0))
+    return 0;
+
+  for (i = 0; i < n; i += m) {
+    m = n - i;
+    if (m > RB64U_CT_BLOCK) m = RB64U_CT_BLOCK;
+    if (m < RB64U_CT_BLOCK) memset(v, 'A', RB64U_CT_BLOCK);
+    memcpy(v, p + i, m);
+    for (j = 0; j < RB64U_CT_BLOCK; j++) {
+      x = b64u_ct_dec(v[j]);
+      err |= x;
+      v[j] = (unsigned char)x;
+    }
+    for (j = 0; j + 4 <= m; j += 4) {
+      diff |= e[k++] ^ (unsigned char)((v[j] << 2) | ((v[j+1] >> 4) & 0x03));
+      diff |= e[k++] ^ (unsigned char)((v[j+1] << 4) | ((v[j+2] >> 2) & 0x0f));
+      diff |= e[k++] ^ (unsigned char)((v[j+2] << 6) | (v[j+3] & 0x3f));
+    }
+    if (m - j >= 2)
+      diff |= e[k++] ^ (unsigned char)((v[j] << 2) | ((v[j+1] >> 4) & 0x03));
+    if (m - j == 3)
+      diff |= e[k++] ^ (unsigned char)((v[j+1] << 4) | ((v[j+2] >> 2) & 0x0f));
+  }
+
+  /* 1 only if no character was rejected and no byte differed */
+  return (int)((((uint32_t)err >> 31) ^ 1) & ((diff - 1) >> 31));
+}
+
+/* decode cache ***************************************************************/
+
+#ifdef RB64U_CACHE
+/**
+ * cached value: the encoded input followed by its decoding, in one block
+ */
+struct b64u_cache_slot
+{
+  uint64_t hash;
+  size_t klen;
+  size_t vlen;
+  char *kv;
+};
+
+/**
+ */
+struct b64u_cache_shard
+{
+  pthread_mutex_t lock;
+  struct b64u_cache_slot *slots;
+  size_t nslots;
+  uint64_t hits;
+  uint64_t misses;
+};
+
+/**
+ */
+struct b64u_cache
+{
+  size_t maxkey;
+  struct b64u_cache_shard shard[RB64U_CACHE_SHARDS];
+};
+
+/**
+ * 64-bit FNV-1a of n bytes of p
+ */
+static uint64_t b64u_hash(const unsigned char *p, size_t n)
+{
+  uint64_t h = ((uint64_t)0xcbf29ce4 << 32) | 0x84222325;
+  const uint64_t prime = ((uint64_t)0x100 << 32) | 0x000001b3;
+  size_t i;
+  for (i = 0; i < n; i++) {
+    h ^= p[i];
+    h *= prime;
+  }
+  return h;
+}
+
+/**
+ */
+RB64U_API b64u_cache_t *base64url_cache_create(size_t capacity, size_t maxkey)
+{
+  b64u_cache_t *c;
+  size_t i, per = (capacity + RB64U_CACHE_SHARDS - 1) / RB64U_CACHE_SHARDS;
+
+  if (0 == per) per = 1;
+  c = (b64u_cache_t *)calloc(1, sizeof(*c));
+  if (NULL == c) return NULL;
+  c->maxkey = maxkey;
+  for (i = 0; i < RB64U_CACHE_SHARDS; i++) {
+    c->shard[i].slots = (struct b64u_cache_slot *)calloc(per, sizeof(struct b64u_cache_slot));
+    c->shard[i].nslots = per;
+    if (NULL == c->shard[i].slots || pthread_mutex_init(&c->shard[i].lock, NULL)) {
+      free(c->shard[i].slots);
+      c->shard[i].slots = NULL;
+      base64url_cache_destroy(c);
+      return NULL;
+    }
+  }
+  return c;
+}
+
+/**
+ */
+RB64U_API void base64url_cache_destroy(b64u_cache_t *cache)
+{
+  size_t i, j;
+  if (NULL == cache) return;
+  for (i = 0; i < RB64U_CACHE_SHARDS; i++) {
+    if (NULL == cache->shard[i].slots) continue;
+    for (j = 0; j < cache->shard[i].nslots; j++)
+      free(cache->shard[i].slots[j].kv);
+    free(cache->shard[i].slots);
+    pthread_mutex_destroy(&cache->shard[i].lock);
+  }
+  free(cache);
+}
+
+/**
+ * the top bits of the hash pick the shard, the rest pick the slot. decoding
+ * and allocation on a miss happen outside the lock.
+ */
+RB64U_API int base64url_decode_cached(b64u_cache_t *cache, char *dest, const size_t maxlen, const char *src, const size_t len, size_t *dlen)
+{
+  struct b64u_cache_shard *sh;
+  struct b64u_cache_slot *sl;
+  uint64_t h;
+  size_t n;
+  char *kv;
+  int r;
+
+  if (NULL == cache || len > cache->maxkey)
+    return base64url_decode(dest, maxlen, src, len, dlen);
+
+  h = b64u_hash((const unsigned char *)src, len);
+  sh = &cache->shard[(h >> 60) & (RB64U_CACHE_SHARDS - 1)];
+  sl = &sh->slots[h % sh->nslots];
+
+  pthread_mutex_lock(&sh->lock);
+  if (NULL != sl->kv && h == sl->hash && len == sl->klen && sl->vlen <= maxlen
+   && 0 == memcmp(sl->kv, src, len)) {
+    memcpy(dest, sl->kv + len, sl->vlen);
+    n = sl->vlen;
+    sh->hits++;
+    pthread_mutex_unlock(&sh->lock);
+    RB64U_STAT_ADD(decode_calls, 1);
+    RB64U_STAT_ADD(decode_in, len);
+    RB64U_STAT_ADD(decode_out, n);
+    RB64U_STAT_ADD(path[RB64U_PATH_CACHE], len);
+    if (NULL != dlen) *dlen = n;
+    return 0;
+  }
+  sh->misses++;
+  pthread_mutex_unlock(&sh->lock);
+
+  r = base64url_decode(dest, maxlen, src, len, &n);
+  if (NULL != dlen) *dlen = n;
+  if (r < 0) return r;
+
+  kv = (char *)malloc(len + n + 1);
+  if (NULL == kv) return r;
+  memcpy(kv, src, len);
+  memcpy(kv + len, dest, n);
+
+  pthread_mutex_lock(&sh->lock);
+  free(sl->kv);
+  sl->kv = kv;
+  sl->hash = h;
+  sl->klen = len;
+  sl->vlen = n;
+  pthread_mutex_unlock(&sh->lock);
+  return r;
+}
+
+/**
+ */
+RB64U_API void base64url_cache_counters(b64u_cache_t *cache, uint64_t *hits, uint64_t *misses)
+{
+  uint64_t th = 0, tm = 0;
+  size_t i;
+  for (i = 0; NULL != cache && i < RB64U_CACHE_SHARDS; i++) {
+    pthread_mutex_lock(&cache->shard[i].lock);
+    th += cache->shard[i].hits;
+    tm += cache->shard[i].misses;
+    pthread_mutex_unlock(&cache->shard[i].lock);
+  }
+  if (NULL != hits) *hits = th;
+  if (NULL != misses) *misses = tm;
+}
+
+#else
+
+/**
+ * the cache is not compiled in: there is nothing to create, and lookups
+ * decode every time
+ */
+RB64U_API b64u_cache_t *base64url_cache_create(size_t capacity, size_t maxkey)
+{
+  (void)capacity;
+  (void)maxkey;
+  return NULL;
+}
+
+/**
+ */
+RB64U_API void base64url_cache_destroy(b64u_cache_t *cache)
+{
+  (void)cache;
+}
+
+/**
+ */
+RB64U_API int base64url_decode_cached(b64u_cache_t *cache, char *dest, const size_t maxlen, const char *src, const size_t len, size_t *dlen)
+{
+  (void)cache;
+  return base64url_decode(dest, maxlen, src, len, dlen);
+}
+
+/**
+ */
+RB64U_API void base64url_cache_counters(b64u_cache_t *cache, uint64_t *hits, uint64_t *misses)
+{
+  (void)cache;
+  if (NULL != hits) *hits = 0;
+  if (NULL != misses) *misses = 0;
+}
+#endif
+
+
+/* re-entrant methods *********************************************************/
+
+/**
+ */
+RB64U_API void base64url_encode_reset(b64ue_t *state)
+{
+  state->n = 0;  /* current state */
+  state->b = 0;  /* last-read buffer */
+  state->r1 = 0; /* retval1 */
+  state->r2 = 0; /* retval2 */
+}
+
+/**
+ */
+RB64U_API int base64url_encode_getc(b64ue_t *state)
+{
+  int r = state->r1;
+  state->r1 = 0;
+  if (r > 0)
+    return r;
+
+  r = state->r2;
+  state->r2 = 0;
+  return r;
+}
+
+/**
+ */
+RB64U_API int base64url_encode_ingest(b64ue_t *state, unsigned char c)
+{
+  int r = b64u_encode_ingest(state, c);
+  RB64U_STAT_ADD(ingest_calls, 1);
+  if (r < 0) {
+    RB64U_STAT_ADD(errors[RB64U_ERR_STATE], 1);
+    return r;
+  }
+  RB64U_STAT_ADD(encode_in, 1);
+  RB64U_STAT_ADD(encode_out, r);
+  RB64U_STAT_ADD(path[RB64U_PATH_STATE], 1);
+  return r;
+}
+
+/**
+ * encoder state machine, shared by base64url_encode_ingest() and the
+ * convenience functions.
+ */
+static int b64u_encode_ingest(b64ue_t *state, unsigned char c)
+{
+  uint8_t i, j, t, n;
+
+  n = state->n;
+  switch (n)
+  {
+    case 0:
+      t = (c & 0xfc) >> 2; /* top six */
+      state->b = c;
+      state->r1 = base64url_etab[t & 0x3f];
+      state->n = 1;
+      return 1;
+
+    case 1:
+      i = (state->b & 0x03) << 4; /* bottom 2 */
+      j = (c & 0xf0) >> 4; /* top 4 */
+      t = i | j;
+      state->b = c;
+      state->r1 = base64url_etab[t & 0x3f];
+      state->n = 2;
+      return 1;
+
+    case 2:
+      i = (state->b & 0x0f) << 2; /* bottom 4 */
+      j = (c & 0xc0) >> 6; /* top 2 */
+      t = i | j;
+      state->r1 = base64url_etab[t & 0x3f];
+      state->r2 = base64url_etab[c & 0x3f]; /* bottom 6 */
+      state->n = 0;
+      return 2;
+  }
+  return -1;
+}
+
+/**
+ */
+RB64U_API int base64url_encode_finish(b64ue_t *state)
+{
+  int r = b64u_encode_finish(state);
+  if (r < 0) {
+    RB64U_STAT_ADD(errors[RB64U_ERR_STATE], 1);
+    return r;
+  }
+  RB64U_STAT_ADD(encode_out, r);
+  return r;
+}
+
+/**
+ */
+static int b64u_encode_finish(b64ue_t *state)
+{
+  uint8_t t;
+
+  switch (state->n)
+  {
+    case 0:
+      return 0;
+
+    case 1:
+      t = (state->b & 0x03) << 4; /* bottom 2 */
+      state->r1 = base64url_etab[t & 0x3f];
+      return 1;
+
+    case 2:
+      t = (state->b & 0x0f) << 2; /* bottom 4 */
+      state->r1 = base64url_etab[t & 0x3f];
+      return 1;
+  }
+  return -1;
+}
+
+/**
+ */
+RB64U_API int base64url_encode_pad(b64ue_t *state)
+{
+  switch (state->n)
+  {
+    case 0:
+      return 0;
+
+    case 1:
+      state->r1 = '=';
+      state->r2 = '=';
+      RB64U_STAT_ADD(encode_out, 2);
+      return 2;
+
+    case 2:
+      state->r1 = '=';
+      RB64U_STAT_ADD(encode_out, 1);
+      return 1;
+  }
+  RB64U_STAT_ADD(errors[RB64U_ERR_STATE], 1);
+  return -1;
+}
+
+/**
+ */
+RB64U_API void base64url_decode_reset(b64ud_t *state)
+{
+  state->n = 0; /* state */
+  state->f = 1; /* finishing flag */
+  state->b = 0; /* last-read buffer */
+  state->r = 0; /* retval */
+}
+
+/**
+ */
+RB64U_API int base64url_decode_getc(b64ud_t *state)
+{
+  int r = state->r;
+  state->r = 0;
+  return r;
+}
+
+/**
+ */
+RB64U_API int base64url_decode_ingest(b64ud_t *state, unsigned char c)
+{
+  int r = b64u_decode_ingest(state, c);
+  RB64U_STAT_ADD(ingest_calls, 1);
+  if (r < 0) {
+    RB64U_STAT_ADD(errors[RB64U_ERR_STATE], 1);
+    return r;
+  }
+  RB64U_STAT_ADD(decode_in, 1);
+  RB64U_STAT_ADD(decode_out, r);
+  RB64U_STAT_ADD(path[RB64U_PATH_STATE], 1);
+  return r;
+}
+
+/**
+ * decoder state machine, shared by base64url_decode_ingest() and
+ * base64url_decode().
+ */
+static int b64u_decode_ingest(b64ud_t *state, unsigned char c)
+{
+  uint8_t i, j, t, n, f;
+
+  f = state->f;
+  if (c == '=') /* toggle finishing flag */
+    state->f = 0;
+
+  n = state->n;
+  switch (n)
+  {
+    case 0:
+      state->b = base64url_dtab[c] & 0x3f; /* buffer first 6 bits */
+      state->n = 1;
+      return 0;
+
+    case 1:
+      t = base64url_dtab[c] & 0x3f;
+      i = state->b << 2; /* buffered 6 bits, to top */
+      j = t >> 4; /* top 2 bits, to bottom */
+      state->r = (i & 0xfc) | (j & 0x03);
+      state->b = t & 0x0f; /* bottom 4 bits, saved */
+      state->n = 2;
+      return f;
+
+    case 2:
+      t = base64url_dtab[c] & 0x3f;
+      i = state->b << 4; /* bottom 4 bits, to top */
+      j = t >> 2; /* top 4 bits, to bottom */
+      state->r = (i & 0xf0) | (j & 0x0f);
+      state->b = t & 0x03; /* bottom 2 bits, saved */
+      state->n = 3;
+      return state->f;
+
+    case 3:
+      t = base64url_dtab[c] & 0x3f; /* bottom 6 bits */
+      i = state->b << 6; /* bottom 2 bits, to top */
+      state->r = (i & 0xc0) | t;
+      state->b = 0;
+      state->n = 0;
+      return state->f;
+  }
+  return -1;
+}
+
+
+/* runtime statistics *********************************************************/
+
+/**
+ */
+RB64U_API int base64url_stats_get(b64u_stats_t *stats)
+{
+#ifdef RB64U_STATS
+  struct b64u_tls *t;
+#endif
+  memset(stats, 0, sizeof(*stats));
+  stats->kernel = b64u_kernel;
+#ifdef RB64U_STATS
+  pthread_mutex_lock(&b64u_stats_lock);
+  b64u_stats_sum(stats, &b64u_stats_retired);
+  for (t = b64u_stats_list; NULL != t; t = t->next)
+    b64u_stats_sum(stats, &t->s);
+  pthread_mutex_unlock(&b64u_stats_lock);
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+/**
+ */
+RB64U_API void base64url_stats_reset(void)
+{
+#ifdef RB64U_STATS
+  struct b64u_tls *t;
+  pthread_mutex_lock(&b64u_stats_lock);
+  memset(&b64u_stats_retired, 0, sizeof(b64u_stats_retired));
+  for (t = b64u_stats_list; NULL != t; t = t->next)
+    memset(&t->s, 0, sizeof(t->s));
+  pthread_mutex_unlock(&b64u_stats_lock);
+#endif
+}
+
+/**
+ */
+RB64U_API const char *base64url_stats_path_name(int path)
+{
+  if (path < 0 || path >= RB64U_PATH_MAX) return NULL;
+  return b64u_path_names[path];
+}
+
+/**
+ */
+RB64U_API const char *base64url_stats_error_name(int err)
+{
+  if (err < 0 || err >= RB64U_ERR_MAX) return NULL;
+  return b64u_error_names[err];
+}
+
+#endif
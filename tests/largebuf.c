@@ -0,0 +1,139 @@
+/**
+ * large-buffer benchmark
+ *
+ * encodes and decodes a buffer much larger than the last-level cache, first
+ * through the cached path and then through the non-temporal path, while a
+ * second thread walks a random cycle through a cache-sized working set. the
+ * walker's step rate shows how much of its working set each path evicts; the
+ * first line is the walker alone.
+ *
+ * usage: largebuf [input MiB] [working set KiB]
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "librb64u.h"
+
+#define ROUNDS 4
+#define LINE   64
+
+static size_t *ring;
+static volatile int running = 1;
+static volatile uint64_t steps;
+
+/**
+ */
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * cache-sensitive workload: chase a random cycle of cache lines
+ */
+static void *walk(void *arg)
+{
+  size_t i = 0, n = 0;
+  while (running) {
+    i = ring[i];
+    if (0 == (++n & 1023)) steps += 1024;
+  }
+  return arg;
+}
+
+/**
+ * lay out a random cycle over lines cache lines of ring
+ */
+static void build_ring(size_t lines)
+{
+  size_t *order = malloc(lines * sizeof(*order));
+  size_t i, j, k, step = LINE / sizeof(*ring);
+  for (i = 0; i < lines; i++) order[i] = i;
+  for (i = lines - 1; i > 0; i--) {
+    j = (size_t)rand() % (i + 1);
+    k = order[i]; order[i] = order[j]; order[j] = k;
+  }
+  for (i = 0; i < lines; i++)
+    ring[order[i] * step] = order[(i + 1) % lines] * step;
+  free(order);
+}
+
+/**
+ * run one path ROUNDS times; print its throughput and the walker's step rate
+ */
+static void measure(const char *name, int decode, size_t threshold, char *dst, size_t dmax, const char *src, size_t len)
+{
+  double t0, t1;
+  uint64_t s0, s1;
+  size_t dlen = 0;
+  int i;
+
+  base64url_set_nt_threshold(threshold);
+  s0 = steps;
+  t0 = now();
+  for (i = 0; i < ROUNDS; i++) {
+    if (decode) base64url_decode(dst, dmax, src, len, &dlen);
+    else base64url_encode(dst, dmax, src, len, &dlen);
+  }
+  t1 = now();
+  s1 = steps;
+  printf("%-8s %-7s %8.2f MB/s   walker %8.2f Msteps/s\n", decode ? "decode" : "encode", name,
+    ROUNDS * len / (t1 - t0) / 1e6, (s1 - s0) / (t1 - t0) / 1e6);
+}
+
+/**
+ */
+int main(int argc, char **argv)
+{
+  size_t mib = 256, kib = 4096, len, elen, i;
+  char *raw, *enc, *dec;
+  pthread_t th;
+  double t0;
+  uint64_t s0;
+
+  if (argc > 1) mib = strtoul(argv[1], NULL, 10);
+  if (argc > 2) kib = strtoul(argv[2], NULL, 10);
+  len = mib << 20;
+  len -= len % 3;
+
+  raw = malloc(len);
+  enc = malloc(len / 3 * 4 + 4);
+  dec = malloc(len);
+  ring = malloc(kib << 10);
+  if (NULL == raw || NULL == enc || NULL == dec || NULL == ring) return -1;
+  srand(1);
+  for (i = 0; i < len; i++) raw[i] = (char)rand();
+  memset(dec, 0, len);
+  build_ring((kib << 10) / LINE);
+
+  base64url_set_nt_threshold((size_t)-1);
+  base64url_encode(enc, len / 3 * 4 + 4, raw, len, &elen);
+
+  if (pthread_create(&th, NULL, walk, NULL)) return -1;
+
+  /* walker alone */
+  s0 = steps;
+  t0 = now();
+  while (now() - t0 < 0.5) ;
+  printf("# %lu MiB input, %lu KiB working set\n", (unsigned long)mib, (unsigned long)kib);
+  printf("%-8s %-7s %8s MB/s   walker %8.2f Msteps/s\n", "idle", "", "-", (steps - s0) / (now() - t0) / 1e6);
+
+  measure("cached", 0, (size_t)-1, enc, len / 3 * 4 + 4, raw, len);
+  measure("nt", 0, 0, enc, len / 3 * 4 + 4, raw, len);
+  measure("cached", 1, (size_t)-1, dec, len, enc, elen);
+  measure("nt", 1, 0, dec, len, enc, elen);
+
+  running = 0;
+  pthread_join(th, NULL);
+  if (memcmp(raw, dec, len)) {
+    printf("FAIL round trip\n");
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,287 @@
+/**
+ * small-payload latency benchmark
+ *
+ * times single calls for every input length from 0 to 128 bytes and reports
+ * the p50/p99/p99.9 cost per call. on x86 the unit is TSC cycles, elsewhere it
+ * is nanoseconds from the monotonic clock. the cost of reading the counter is
+ * measured up front and subtracted.
+ *
+ * each path is timed twice: "fixed" repeats one length back to back, which
+ * lets the branch predictor learn it; "random" interleaves all lengths in a
+ * shuffled order, which is closer to a request path with mixed token sizes.
+ *
+ * usage: latency [samples per length]
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "librb64u.h"
+
+#define MAXLEN   128
+#define NLEN     (MAXLEN + 1)
+#define SAMPLES  2000
+
+#if defined(__x86_64__) || defined(__i386__)
+#define UNIT "cycles"
+static uint64_t now(void)
+{
+  uint32_t lo, hi;
+  __asm__ __volatile__ ("lfence\n\trdtsc" : "=a" (lo), "=d" (hi) : : "memory");
+  return ((uint64_t)hi << 32) | lo;
+}
+#else
+#define UNIT "ns"
+static uint64_t now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+typedef int (*op_fn)(size_t len);
+
+static char   raw[MAXLEN];
+static char   enc[NLEN][MAXLEN * 2];
+static size_t enclen[NLEN];
+static char   out[MAXLEN * 2];
+static volatile size_t sink;
+static b64u_cache_t *cache;
+
+/**
+ */
+static int op_encode(size_t len)
+{
+  size_t dlen;
+  int r = base64url_encode(out, sizeof(out), raw, len, &dlen);
+  sink += dlen;
+  return r;
+}
+
+/**
+ */
+static int op_decode(size_t len)
+{
+  size_t dlen;
+  int r = base64url_decode(out, sizeof(out), enc[len], enclen[len], &dlen);
+  sink += dlen;
+  return r;
+}
+
+/**
+ * decode through a cache that holds every length, so all calls but the
+ * first per length are hits. without RB64U_CACHE every call decodes.
+ */
+static int op_decode_cached(size_t len)
+{
+  size_t dlen;
+  int r = base64url_decode_cached(cache, out, sizeof(out), enc[len], enclen[len], &dlen);
+  sink += dlen;
+  return r;
+}
+
+/**
+ */
+static int op_encode_ct(size_t len)
+{
+  size_t dlen;
+  int r = base64url_encode_ct(out, sizeof(out), raw, len, &dlen);
+  sink += dlen;
+  return r;
+}
+
+/**
+ */
+static int op_decode_ct(size_t len)
+{
+  size_t dlen;
+  int r = base64url_decode_ct(out, sizeof(out), enc[len], enclen[len], &dlen);
+  sink += dlen;
+  return r;
+}
+
+/**
+ */
+static int op_validate(size_t len)
+{
+  size_t n;
+  int r = base64url_validate(enc[len], enclen[len], 0, &n, NULL);
+  sink += n;
+  return r;
+}
+
+/**
+ * decode-and-compare against the raw bytes, which always match
+ */
+static int op_equals(size_t len)
+{
+  int r = base64url_decode_equals(enc[len], enclen[len], raw, len);
+  sink += r;
+  return r;
+}
+
+/**
+ */
+static int op_equals_ct(size_t len)
+{
+  int r = base64url_decode_equals_ct(enc[len], enclen[len], raw, len);
+  sink += r;
+  return r;
+}
+
+/**
+ * the read/write loop from the README, over a buffer
+ */
+static int op_stream(size_t len)
+{
+  b64ue_t s;
+  size_t i, k = 0;
+  int r;
+  base64url_encode_reset(&s);
+  for (i = 0; i < len; i++) {
+    r = base64url_encode_ingest(&s, raw[i]);
+    if (r < 0) return r;
+    while (r-- > 0) out[k++] = base64url_encode_getc(&s);
+  }
+  r = base64url_encode_finish(&s);
+  if (r < 0) return r;
+  while (r-- > 0) out[k++] = base64url_encode_getc(&s);
+  sink += k;
+  return 0;
+}
+
+/**
+ */
+static int op_none(size_t len)
+{
+  sink += len;
+  return 0;
+}
+
+/**
+ */
+static int cmp_u32(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * p-th percentile of n sorted samples, p in thousandths
+ */
+static uint32_t pct(const uint32_t *v, size_t n, unsigned p)
+{
+  return v[(n - 1) * p / 1000];
+}
+
+/**
+ * time one call of fn, less the counter overhead
+ */
+static uint32_t sample(op_fn fn, size_t len, uint32_t overhead)
+{
+  uint64_t t0, t1;
+  t0 = now();
+  fn(len);
+  t1 = now();
+  t1 -= t0;
+  return (t1 > overhead) ? (uint32_t)(t1 - overhead) : 0;
+}
+
+/**
+ * fill t[len * n + i] with n samples per length. in random order, the
+ * sequence of lengths is shuffled across the whole run.
+ */
+static void run(op_fn fn, uint32_t *t, size_t n, int random, uint32_t overhead)
+{
+  size_t *seq, fill[NLEN] = { 0 };
+  size_t i, j, k, len;
+
+  if (!random) {
+    for (len = 0; len < NLEN; len++) {
+      for (i = 0; i < n / 10; i++) fn(len); /* warm up */
+      for (i = 0; i < n; i++) t[len * n + i] = sample(fn, len, overhead);
+    }
+    return;
+  }
+
+  seq = malloc(NLEN * n * sizeof(*seq));
+  if (NULL == seq) return;
+  for (i = 0; i < NLEN * n; i++) seq[i] = i % NLEN;
+  for (i = NLEN * n - 1; i > 0; i--) {
+    j = (size_t)rand() % (i + 1);
+    k = seq[i]; seq[i] = seq[j]; seq[j] = k;
+  }
+  for (i = 0; i < NLEN * n; i++) {
+    len = seq[i];
+    t[len * n + fill[len]++] = sample(fn, len, overhead);
+  }
+  free(seq);
+}
+
+/**
+ */
+static void report(const char *name, const char *mode, uint32_t *t, size_t n)
+{
+  size_t len;
+  for (len = 0; len < NLEN; len++) {
+    uint32_t *v = t + len * n;
+    qsort(v, n, sizeof(*v), cmp_u32);
+    printf("%-13s %-7s %4lu %8lu %8lu %8lu\n", name, mode, (unsigned long)len,
+      (unsigned long)pct(v, n, 500), (unsigned long)pct(v, n, 990), (unsigned long)pct(v, n, 999));
+  }
+}
+
+/**
+ */
+int main(int argc, char **argv)
+{
+  static const struct { const char *name; op_fn fn; } ops[] = {
+    { "encode", op_encode },
+    { "decode", op_decode },
+    { "decode_cached", op_decode_cached },
+    { "encode_ct", op_encode_ct },
+    { "decode_ct", op_decode_ct },
+    { "validate", op_validate },
+    { "equals", op_equals },
+    { "equals_ct", op_equals_ct },
+    { "stream", op_stream }
+  };
+  uint32_t *t, overhead;
+  size_t i, n = SAMPLES;
+  int m;
+
+  if (argc > 1) n = strtoul(argv[1], NULL, 10);
+  if (n < 10) n = 10;
+
+  srand(1);
+  for (i = 0; i < MAXLEN; i++) raw[i] = (char)rand();
+  for (i = 0; i < NLEN; i++)
+    base64url_encode(enc[i], sizeof(enc[i]), raw, i, &enclen[i]);
+
+  t = malloc(NLEN * n * sizeof(*t));
+  cache = base64url_cache_create(NLEN * 16, MAXLEN * 2);
+  if (NULL == t) return -1;
+#ifdef RB64U_CACHE
+  if (NULL == cache) return -1;
+#endif
+
+  /* counter overhead: median of empty measurements */
+  run(op_none, t, n, 0, 0);
+  qsort(t, n, sizeof(*t), cmp_u32);
+  overhead = pct(t, n, 500);
+
+  printf("# unit %s, %lu samples per length, overhead %lu subtracted\n", UNIT, (unsigned long)n, (unsigned long)overhead);
+  printf("# %-11s %-7s %4s %8s %8s %8s\n", "path", "order", "len", "p50", "p99", "p99.9");
+  for (i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+    for (m = 0; m < 2; m++) {
+      run(ops[i].fn, t, n, m, overhead);
+      report(ops[i].name, m ? "random" : "fixed", t, n);
+    }
+  }
+  base64url_cache_destroy(cache);
+  free(t);
+  return 0;
+}
@@ -0,0 +1,538 @@
+/**
+ * performance regression check, for 'make check-perf'
+ *
+ * runs a fixed matrix of throughput (MB/s of input) and latency (median ns
+ * per call) measurements over the encode/decode paths. the matrix is run
+ * several times, interleaved so that drift in clock speed or background load
+ * is spread over every entry, and each entry is summarized by its median and
+ * a distribution-free confidence interval for the median from the order
+ * statistics of the runs.
+ *
+ * the results are compared with the baseline for this host, a JSON file in
+ * the baseline directory named after the OS, architecture, CPU model, CPU
+ * count and host name. CPU model strings are often generic on virtual
+ * machines, so baselines are recorded on the machine that checks against
+ * them and none are shipped.
+ *
+ * clock speed, other guests and thermal state drift within and between
+ * sessions. so every measurement is taken between two of a reference loop
+ * that does not use the library, and the entry is compared as a ratio to
+ * their mean: throughput as speed relative to the reference ("xref"),
+ * latency as the bytes the reference loop gets through in the same time
+ * ("refB"). medians and intervals are built on these ratios. an entry is a
+ * regression when its median is worse than the baseline's by more than the
+ * threshold and its interval leaves out the baseline median; worse by more
+ * than the threshold otherwise is reported as noise. exits 1 if there is a
+ * regression, and 2 if there is no baseline, since then nothing was checked.
+ *
+ * usage: perf [-n runs] [-t [path=]percent]... [-d dir] [-H host] [-u]
+ *
+ *   -n runs      runs of the matrix (default 9)
+ *   -t percent   regression threshold (default 10); path=percent sets it for
+ *                the entries whose name starts with path, e.g. decode_ct=20
+ *                or encode/64=15. -t may repeat or hold a list, "10 stream=25"
+ *   -d dir       baseline directory (default "baselines")
+ *   -H host      host class, instead of the one detected
+ *   -u           write the results as the new baseline instead of comparing
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <ctype.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+#include "librb64u.h"
+
+#define RUNS        9
+#define MAXRUNS     101
+#define THRESHOLD   10.0
+#define RUN_SEC     0.02     /* length of one throughput measurement */
+#define LAT_BATCH   64       /* calls per latency sample */
+#define LAT_SAMPLES 201
+#define RAWLEN      (1 << 20)
+#define REFLEN      4096     /* bytes per call of the reference loop */
+#define MAXBASE     64
+#define MAXTOL      32
+
+typedef void (*op_fn)(size_t len);
+
+static char *raw, *enc, *out;
+static size_t outlen;
+static volatile size_t sink;
+
+/**
+ */
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * operations: encode len bytes of raw, or decode the first len characters of
+ * its encoding
+ */
+static void op_encode(size_t len)
+{
+  size_t dlen;
+  base64url_encode(out, outlen, raw, len, &dlen);
+  sink += dlen;
+}
+
+static void op_decode(size_t len)
+{
+  size_t dlen;
+  base64url_decode(out, outlen, enc, len, &dlen);
+  sink += dlen;
+}
+
+static void op_encode_nt(size_t len)
+{
+  size_t dlen;
+  base64url_encode_nt(out, outlen, raw, len, &dlen);
+  sink += dlen;
+}
+
+static void op_decode_nt(size_t len)
+{
+  size_t dlen;
+  base64url_decode_nt(out, outlen, enc, len, &dlen);
+  sink += dlen;
+}
+
+static void op_encode_ct(size_t len)
+{
+  size_t dlen;
+  base64url_encode_ct(out, outlen, raw, len, &dlen);
+  sink += dlen;
+}
+
+static void op_decode_ct(size_t len)
+{
+  size_t dlen;
+  base64url_decode_ct(out, outlen, enc, len, &dlen);
+  sink += dlen;
+}
+
+static void op_validate(size_t len)
+{
+  size_t n;
+  base64url_validate(enc, len, 0, &n, NULL);
+  sink += n;
+}
+
+/**
+ * the reference: a byte-at-a-time decoder written here, without the library.
+ * it has the shape of the library's scalar paths, a table lookup and a switch
+ * on the state for every byte, so clock speed and a busy sibling thread move
+ * it the way they move those paths. its table is filled at run time so the
+ * compiler cannot fold the lookups away.
+ */
+static unsigned char ref_tab[256];
+
+static void op_reference(size_t len)
+{
+  const unsigned char *p = (const unsigned char *)enc;
+  unsigned char *d = (unsigned char *)out;
+  unsigned char b = 0, t;
+  size_t i, k = 0;
+  int n = 0;
+  for (i = 0; i < len; i++) {
+    t = ref_tab[p[i]] & 0x3f;
+    switch (n) {
+      case 0: b = t; n = 1; break;
+      case 1: d[k++] = (unsigned char)(b << 2 | t >> 4); b = t & 0x0f; n = 2; break;
+      case 2: d[k++] = (unsigned char)(b << 4 | t >> 2); b = t & 0x03; n = 3; break;
+      case 3: d[k++] = (unsigned char)(b << 6 | t); n = 0; break;
+    }
+  }
+  sink += k;
+}
+
+/**
+ * the read/write loop from the README, over a buffer
+ */
+static void op_stream(size_t len)
+{
+  b64ue_t s;
+  size_t i, k = 0;
+  int r;
+  base64url_encode_reset(&s);
+  for (i = 0; i < len; i++) {
+    r = base64url_encode_ingest(&s, raw[i]);
+    while (r-- > 0) out[k++] = base64url_encode_getc(&s);
+  }
+  r = base64url_encode_finish(&s);
+  while (r-- > 0) out[k++] = base64url_encode_getc(&s);
+  sink += k;
+}
+
+/**
+ * one entry of the matrix
+ */
+struct metric
+{
+  const char *path;
+  op_fn fn;
+  size_t len;
+  int latency;               /* ns per call, lower is better; else MB/s */
+  char name[40];
+  double raw[MAXRUNS];       /* as measured */
+  double v[MAXRUNS];         /* as a ratio to the reference, see main() */
+  double median, lo, hi, raw_median;
+};
+
+static struct metric matrix[] = {
+  { "encode", op_encode, 64, 0 },
+  { "encode", op_encode, 4096, 0 },
+  { "encode", op_encode, RAWLEN, 0 },
+  { "decode", op_decode, 64, 0 },
+  { "decode", op_decode, 4096, 0 },
+  { "decode", op_decode, RAWLEN, 0 },
+  { "encode_nt", op_encode_nt, RAWLEN, 0 },
+  { "decode_nt", op_decode_nt, RAWLEN, 0 },
+  { "encode_ct", op_encode_ct, 4096, 0 },
+  { "decode_ct", op_decode_ct, 4096, 0 },
+  { "validate", op_validate, 4096, 0 },
+  { "stream", op_stream, 4096, 0 },
+  { "encode", op_encode, 32, 1 },
+  { "decode", op_decode, 44, 1 },
+  { "encode_ct", op_encode_ct, 32, 1 },
+  { "decode_ct", op_decode_ct, 44, 1 },
+  { "validate", op_validate, 44, 1 }
+};
+#define NMETRIC (sizeof(matrix) / sizeof(matrix[0]))
+
+/**
+ * a baseline entry, or a per-path threshold
+ */
+struct base
+{
+  char name[40];
+  double median, lo, hi;
+};
+
+struct tol
+{
+  char path[40];
+  double pct;
+};
+
+/**
+ * MB/s over RUN_SEC, reading the clock once per batch of calls
+ */
+static double throughput(op_fn fn, size_t len)
+{
+  size_t i, n = 0, batch = 1 + (1 << 16) / len;
+  double t0, t;
+  fn(len);
+  t0 = now();
+  do {
+    for (i = 0; i < batch; i++) fn(len);
+    n += batch;
+    t = now() - t0;
+  } while (t < RUN_SEC);
+  return n * (double)len / t / 1e6;
+}
+
+/**
+ */
+static int cmp_double(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * median ns per call, over samples of LAT_BATCH calls
+ */
+static double latency(op_fn fn, size_t len)
+{
+  double s[LAT_SAMPLES], t0;
+  int i, j;
+  for (j = 0; j < LAT_BATCH; j++) fn(len);
+  for (i = 0; i < LAT_SAMPLES; i++) {
+    t0 = now();
+    for (j = 0; j < LAT_BATCH; j++) fn(len);
+    s[i] = (now() - t0) * 1e9 / LAT_BATCH;
+  }
+  qsort(s, LAT_SAMPLES, sizeof(s[0]), cmp_double);
+  return s[LAT_SAMPLES / 2];
+}
+
+/**
+ * the rank k (from 1) such that the k-th smallest and k-th largest of n runs
+ * bound the median with the highest confidence of at least 95%, from the
+ * binomial distribution; 1 if n is too small for that. sets level to the
+ * confidence achieved.
+ */
+static int ci_rank(int n, double *level)
+{
+  double p = 1, cdf, cover;
+  int i, k;
+  for (i = 0; i < n; i++) p /= 2;        /* P(X = 0) for X ~ B(n, 1/2) */
+  cdf = p;
+  *level = 1 - 2 * cdf;                  /* rank 1: min and max */
+  for (k = 1; k < n / 2; k++) {
+    p = p * (n - k + 1) / k;             /* P(X = k) */
+    cover = 1 - 2 * (cdf + p);           /* rank k + 1 */
+    if (cover < 0.95) break;
+    cdf += p;
+    *level = cover;
+  }
+  return k;
+}
+
+/**
+ */
+static void summarize(struct metric *m, int n, int k)
+{
+  double v[MAXRUNS];
+  memcpy(v, m->v, n * sizeof(v[0]));
+  qsort(v, n, sizeof(v[0]), cmp_double);
+  m->median = (n & 1) ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+  m->lo = v[k - 1];
+  m->hi = v[n - k];
+  memcpy(v, m->raw, n * sizeof(v[0]));
+  qsort(v, n, sizeof(v[0]), cmp_double);
+  m->raw_median = (n & 1) ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+/**
+ * OS, architecture, CPU model, CPU count and host name, as a file name
+ */
+static void host_class(char *dst, size_t max)
+{
+  struct utsname u;
+  char line[256], model[128] = "unknown", buf[400], *p;
+  FILE *f;
+  size_t i, n = 0;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (uname(&u)) {
+    strcpy(u.sysname, "unknown");
+    strcpy(u.machine, "unknown");
+    strcpy(u.nodename, "unknown");
+  }
+  f = fopen("/proc/cpuinfo", "r");
+  if (NULL != f) {
+    while (fgets(line, sizeof(line), f)) {
+      if (strncmp(line, "model name", 10) && strncmp(line, "Model", 5) && strncmp(line, "cpu model", 9))
+        continue;
+      p = strchr(line, ':');
+      if (NULL == p) continue;
+      strncpy(model, p + 1, sizeof(model) - 1);
+      model[sizeof(model) - 1] = 0;
+      break;
+    }
+    fclose(f);
+  }
+  sprintf(buf, "%.63s-%.63s-%.127s-%ldcpu-%.63s", u.sysname, u.machine, model, cpus, u.nodename);
+  for (i = 0; buf[i] && n + 1 < max; i++) {
+    if (isalnum((unsigned char)buf[i]) || '_' == buf[i])
+      dst[n++] = (char)tolower((unsigned char)buf[i]);
+    else if (n > 0 && '-' != dst[n - 1])
+      dst[n++] = '-';
+  }
+  while (n > 0 && '-' == dst[n - 1]) n--;
+  dst[n] = 0;
+}
+
+/**
+ * read the entries of a baseline written by save(); returns the number read,
+ * or -1 if the file cannot be opened
+ */
+static int load(const char *file, struct base *b, int max)
+{
+  char line[256];
+  FILE *f = fopen(file, "r");
+  int n = 0;
+  if (NULL == f) return -1;
+  while (n < max && fgets(line, sizeof(line), f)) {
+    if (4 == sscanf(line, " { \"name\": \"%39[^\"]\", \"median\": %lf, \"lo\": %lf, \"hi\": %lf",
+                    b[n].name, &b[n].median, &b[n].lo, &b[n].hi))
+      n++;
+  }
+  fclose(f);
+  return n;
+}
+
+/**
+ */
+static int save(const char *file, const char *host, int runs, double level)
+{
+  FILE *f = fopen(file, "w");
+  size_t i;
+  if (NULL == f) return -1;
+  fprintf(f, "{\n  \"host\": \"%s\",\n  \"runs\": %d,\n  \"confidence\": %.3f,\n  \"results\": [\n",
+    host, runs, level);
+  for (i = 0; i < NMETRIC; i++)
+    fprintf(f, "    { \"name\": \"%s\", \"median\": %.4g, \"lo\": %.4g, \"hi\": %.4g, \"unit\": \"%s\", \"raw\": %.4g, \"raw_unit\": \"%s\" }%s\n",
+      matrix[i].name, matrix[i].median, matrix[i].lo, matrix[i].hi, matrix[i].latency ? "refB" : "xref",
+      matrix[i].raw_median, matrix[i].latency ? "ns" : "MB/s", i + 1 < NMETRIC ? "," : "");
+  fprintf(f, "  ]\n}\n");
+  return fclose(f) ? -1 : 0;
+}
+
+/**
+ * threshold for an entry: the longest matching path=percent, else the default
+ */
+static double threshold(const char *name, const struct tol *t, int nt, double def)
+{
+  size_t n, best = 0;
+  int i;
+  for (i = 0; i < nt; i++) {
+    n = strlen(t[i].path);
+    if (n > best && !strncmp(name, t[i].path, n) && ('/' == name[n] || 0 == name[n])) {
+      best = n;
+      def = t[i].pct;
+    }
+  }
+  return def;
+}
+
+/**
+ * print each entry against the baseline; returns the number of regressions
+ */
+static int compare(const struct base *b, int nb, const struct tol *t, int nt, double def)
+{
+  const struct metric *m;
+  const struct base *e;
+  double gain, pct;
+  const char *verdict;
+  size_t i;
+  int j, bad = 0, worse, clear;
+
+  printf("%-24s %-5s %10s %10s %23s %8s %-10s %10s\n", "# entry", "unit", "baseline", "now", "interval", "change",
+    "", "measured");
+  for (i = 0; i < NMETRIC; i++) {
+    m = &matrix[i];
+    e = NULL;
+    for (j = 0; j < nb; j++)
+      if (!strcmp(b[j].name, m->name)) e = &b[j];
+    if (NULL == e) {
+      printf("%-24s %-5s %10s %10.4g [%10.4g, %10.4g] %8s %-10s %10.4g %s\n", m->name, m->latency ? "refB" : "xref",
+        "-", m->median, m->lo, m->hi, "", "new", m->raw_median, m->latency ? "ns" : "MB/s");
+      continue;
+    }
+    /* gain is positive when faster, for both units */
+    gain = m->latency ? e->median / m->median - 1 : m->median / e->median - 1;
+    /* the interval leaves out the baseline median */
+    clear = m->hi < e->median || m->lo > e->median;
+    pct = threshold(m->name, t, nt, def);
+    worse = gain * 100 < -pct;
+    if (worse && clear) {
+      verdict = "REGRESSION";
+      bad++;
+    }
+    else if (worse) verdict = "noise";
+    else if (gain * 100 > pct && clear) verdict = "faster";
+    else verdict = "ok";
+    printf("%-24s %-5s %10.4g %10.4g [%10.4g, %10.4g] %+7.1f%% %-10s %10.4g %s\n", m->name,
+      m->latency ? "refB" : "xref", e->median, m->median, m->lo, m->hi, gain * 100, verdict,
+      m->raw_median, m->latency ? "ns" : "MB/s");
+  }
+  return bad;
+}
+
+/**
+ */
+int main(int argc, char **argv)
+{
+  static struct base b[MAXBASE];
+  struct tol t[MAXTOL];
+  const char *dir = "baselines";
+  char host[192] = "", file[512], *eq, *w;
+  double def = THRESHOLD, level, ref, after, v;
+  int i, k, r, nb, nt = 0, runs = RUNS, update = 0;
+  size_t j, elen;
+
+  for (i = 1; i < argc; i++) {
+    if (!strcmp("-u", argv[i]))
+      update = 1;
+    else if (!strcmp("-n", argv[i]) && i + 1 < argc)
+      runs = atoi(argv[++i]);
+    else if (!strcmp("-d", argv[i]) && i + 1 < argc)
+      dir = argv[++i];
+    else if (!strcmp("-H", argv[i]) && i + 1 < argc) {
+      strncpy(host, argv[++i], sizeof(host) - 1);
+      host[sizeof(host) - 1] = 0;
+    }
+    else if (!strcmp("-t", argv[i]) && i + 1 < argc) {
+      for (w = strtok(argv[++i], " ,"); NULL != w; w = strtok(NULL, " ,")) {
+        eq = strchr(w, '=');
+        if (NULL == eq) def = atof(w);
+        else if (nt < MAXTOL && (size_t)(eq - w) < sizeof(t[nt].path)) {
+          memcpy(t[nt].path, w, eq - w);
+          t[nt].path[eq - w] = 0;
+          t[nt++].pct = atof(eq + 1);
+        }
+      }
+    }
+    else {
+      fprintf(stderr, "usage: %s [-n runs] [-t [path=]percent]... [-d dir] [-H host] [-u]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (runs < 1) runs = 1;
+  if (runs > MAXRUNS) runs = MAXRUNS;
+  if (0 == host[0]) host_class(host, sizeof(host));
+  sprintf(file, "%.300s/%.190s.json", dir, host);
+
+  elen = RAWLEN / 3 * 4 + 4;
+  outlen = 2 * elen;
+  raw = malloc(RAWLEN);
+  enc = malloc(elen);
+  out = malloc(outlen);
+  if (NULL == raw || NULL == enc || NULL == out) return 2;
+  srand(1);
+  for (j = 0; j < RAWLEN; j++) raw[j] = (char)rand();
+  for (j = 0; j < sizeof(ref_tab); j++) ref_tab[j] = (unsigned char)rand();
+  base64url_encode(enc, elen, raw, RAWLEN, &elen);
+  for (j = 0; j < NMETRIC; j++)
+    sprintf(matrix[j].name, "%s/%lu%s", matrix[j].path, (unsigned long)matrix[j].len, matrix[j].latency ? "/p50" : "");
+
+  /* each measurement is bracketed by two of the reference and divided by
+   * their mean, so both see the same clock speed and load */
+  for (k = 0; k < runs; k++) {
+    ref = throughput(op_reference, REFLEN);
+    for (j = 0; j < NMETRIC; j++) {
+      v = matrix[j].latency ? latency(matrix[j].fn, matrix[j].len) : throughput(matrix[j].fn, matrix[j].len);
+      after = throughput(op_reference, REFLEN);
+      matrix[j].raw[k] = v;
+      matrix[j].v[k] = matrix[j].latency ? v * (ref + after) / 2e3 : v * 2 / (ref + after);
+      ref = after;
+    }
+  }
+  k = ci_rank(runs, &level);
+  for (j = 0; j < NMETRIC; j++) summarize(&matrix[j], runs, k);
+
+  printf("# host %s, %d runs, median with %.1f%% interval\n", host, runs, level * 100);
+  if (update) {
+    if (save(file, host, runs, level) < 0) {
+      fprintf(stderr, "%s: cannot write %s\n", argv[0], file);
+      return 2;
+    }
+    printf("# baseline written to %s\n", file);
+    return 0;
+  }
+
+  nb = load(file, b, MAXBASE);
+  if (nb < 0) {
+    printf("# nothing checked: no baseline %s for this host; 'make perf-baseline' records one\n", file);
+    free(raw);
+    free(enc);
+    free(out);
+    return 2;
+  }
+  printf("# regression: more than %.1f%% worse, interval clear of the baseline median\n", def);
+  r = compare(b, nb, t, nt, def);
+  if (r > 0) printf("# %d regression%s\n", r, r > 1 ? "s" : "");
+  free(raw);
+  free(enc);
+  free(out);
+  return r > 0;
+}
@@ -0,0 +1,197 @@
+/**
+ * timing-variance test for the constant-time codec
+ *
+ * measures each function on two classes of input of the same length, in a
+ * random interleaving, and compares the two timing distributions with Welch's
+ * t-test (the dudect method). a constant-time function should show no
+ * difference: |t| stays small no matter how many samples are taken. |t| above
+ * 10 is treated as a leak.
+ *
+ * the table-driven base64url_decode() is measured too, for reference; its
+ * table is small enough to stay in L1, so on most machines it does not show a
+ * difference here either, which is why this is only a lower bound.
+ *
+ * usage: timing [samples]
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "librb64u.h"
+
+#define SAMPLES 200000
+#define KEYLEN  32
+#define ENCLEN  43
+#define LEAK    10.0
+
+#if defined(__x86_64__) || defined(__i386__)
+static uint64_t now(void)
+{
+  uint32_t lo, hi;
+  __asm__ __volatile__ ("lfence\n\trdtsc" : "=a" (lo), "=d" (hi) : : "memory");
+  return ((uint64_t)hi << 32) | lo;
+}
+#else
+static uint64_t now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+typedef int (*op_fn)(const char *in);
+
+static char out[128];
+static char token[ENCLEN + 1];
+static volatile size_t sink;
+
+/**
+ */
+static int op_encode_ct(const char *in)
+{
+  size_t dlen;
+  int r = base64url_encode_ct(out, sizeof(out), in, KEYLEN, &dlen);
+  sink += dlen;
+  return r;
+}
+
+/**
+ */
+static int op_decode_ct(const char *in)
+{
+  size_t dlen;
+  int r = base64url_decode_ct(out, sizeof(out), in, ENCLEN, &dlen);
+  sink += dlen;
+  return r;
+}
+
+/**
+ * compare a fixed token against in, one of two expected values
+ */
+static int op_equals_ct(const char *in)
+{
+  int r = base64url_decode_equals_ct(token, ENCLEN, in, KEYLEN);
+  sink += r;
+  return r;
+}
+
+/**
+ */
+static int op_decode(const char *in)
+{
+  size_t dlen;
+  int r = base64url_decode(out, sizeof(out), in, ENCLEN, &dlen);
+  sink += dlen;
+  return r;
+}
+
+/**
+ * online mean and variance
+ */
+struct moments
+{
+  double n, mean, m2;
+};
+
+static void push(struct moments *m, double x)
+{
+  double d = x - m->mean;
+  m->n += 1;
+  m->mean += d / m->n;
+  m->m2 += d * (x - m->mean);
+}
+
+/**
+ */
+static int cmp_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * time fn on inputs a (class 0) and b (class 1), chosen at random per sample,
+ * and return Welch's t statistic. samples above the 95th percentile are
+ * dropped as interrupts and other noise.
+ */
+static double welch(op_fn fn, const char *a, const char *b, size_t n)
+{
+  struct moments m[2];
+  uint64_t *t, *sorted, cut, t0;
+  unsigned char *cls;
+  size_t i;
+
+  memset(m, 0, sizeof(m));
+  t = malloc(n * sizeof(*t));
+  sorted = malloc(n * sizeof(*sorted));
+  cls = malloc(n);
+  if (NULL == t || NULL == sorted || NULL == cls) {
+    free(t); free(sorted); free(cls);
+    return 0;
+  }
+  for (i = 0; i < n; i++) cls[i] = rand() & 1;
+  for (i = 0; i < n; i++) {
+    const char *in = cls[i] ? b : a;
+    t0 = now();
+    fn(in);
+    t[i] = now() - t0;
+  }
+  memcpy(sorted, t, n * sizeof(*t));
+  qsort(sorted, n, sizeof(*sorted), cmp_u64);
+  cut = sorted[n * 95 / 100];
+  for (i = 0; i < n; i++)
+    if (t[i] <= cut) push(&m[cls[i]], (double)t[i]);
+  free(t); free(sorted); free(cls);
+
+  if (m[0].n < 2 || m[1].n < 2) return 0;
+  return (m[0].mean - m[1].mean)
+       / sqrt(m[0].m2 / (m[0].n - 1) / m[0].n + m[1].m2 / (m[1].n - 1) / m[1].n);
+}
+
+/**
+ */
+static int check(const char *name, op_fn fn, const char *a, const char *b, size_t n, int ct)
+{
+  double t = welch(fn, a, b, n);
+  int leak = fabs(t) > LEAK;
+  printf("%-10s %-28s t=%8.2f %s\n", name, ct ? "(constant-time)" : "(reference)", t,
+    leak ? "LEAK" : "ok");
+  return (ct && leak) ? -1 : 0;
+}
+
+/**
+ */
+int main(int argc, char **argv)
+{
+  char zero[KEYLEN], key[KEYLEN], bkey[KEYLEN];
+  char ezero[ENCLEN + 1], ekey[ENCLEN + 1], ebad[ENCLEN + 1];
+  size_t i, n = SAMPLES, dlen;
+  int r = 0;
+
+  if (argc > 1) n = strtoul(argv[1], NULL, 10);
+  if (n < 100) n = 100;
+
+  srand(1);
+  memset(zero, 0, KEYLEN);
+  for (i = 0; i < KEYLEN; i++) key[i] = (char)rand();
+  base64url_encode(ezero, sizeof(ezero), zero, KEYLEN, &dlen);
+  base64url_encode(ekey, sizeof(ekey), key, KEYLEN, &dlen);
+  memcpy(ebad, ekey, ENCLEN);
+  ebad[0] = '+'; /* not in the alphabet */
+
+  printf("# Welch's t over %lu samples, |t| > %.0f is a leak\n", (unsigned long)n, LEAK);
+  r |= check("encode_ct", op_encode_ct, zero, key, n, 1);
+  r |= check("decode_ct", op_decode_ct, ezero, ekey, n, 1);
+  r |= check("decode_ct", op_decode_ct, ekey, ebad, n, 1);
+  /* a match against a mismatch in the first byte */
+  base64url_encode(token, sizeof(token), key, KEYLEN, &dlen);
+  memcpy(bkey, key, KEYLEN);
+  bkey[0] ^= 1;
+  r |= check("equals_ct", op_equals_ct, key, bkey, n, 1);
+  r |= check("decode", op_decode, ezero, ekey, n, 0);
+  return r;
+}
@@ -4,6 +4,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#ifdef RB64U_CACHE
+#include <pthread.h>
+#endif
 #include "librb64u.h"
 
 
@@ -367,6 +370,500 @@ int verify_all(char *source, size_t len, size_t max)
 }
 
 
+/**
+ * every byte range of every length up to 32, with and without padding,
+ * including ranges that run past the end.
+ */
+int range()
+{
+  char raw[32], enc[64], dec[40];
+  size_t len, elen, off, cnt, dlen, want;
+  int r, pad;
+
+  srand(2);
+  for (off = 0; off < 32; off++) raw[off] = (char)rand();
+
+  for (len = 0; len <= 32; len++) {
+    for (pad = 0; pad < 2; pad++) {
+      if (pad) base64url_encode_padded(enc, 63, raw, len, &elen);
+      else base64url_encode(enc, 63, raw, len, &elen);
+      for (off = 0; off <= len; off++) {
+        for (cnt = 0; cnt <= len - off + 3; cnt++) {
+          want = (cnt < len - off) ? cnt : len - off;
+          memset(dec, 0, 40);
+          r = base64url_decode_range(dec, enc, elen, off, cnt, &dlen);
+          if (r < 0 || dlen != want || memcmp(dec, raw + off, want)) {
+            printf("FAIL range \"%.*s\" offset=%lu count=%lu r=%d dlen=%lu\n",
+              (int)elen, enc, off, cnt, r, dlen);
+            return -1;
+          }
+        }
+      }
+      /* the rest of the data, however large count is */
+      for (off = 0; off <= len; off++) {
+        for (cnt = (size_t)-3; cnt != 0; cnt++) {
+          r = base64url_decode_range(dec, enc, elen, off, cnt, &dlen);
+          if (r < 0 || dlen != len - off || memcmp(dec, raw + off, len - off)) {
+            printf("FAIL range \"%.*s\" offset=%lu count=SIZE_MAX-%lu r=%d dlen=%lu\n",
+              (int)elen, enc, off, (size_t)-1 - cnt, r, dlen);
+            return -1;
+          }
+        }
+      }
+      if (base64url_decode_range(dec, enc, elen, len + 1, 1, &dlen) >= 0 || 0 != dlen) {
+        printf("FAIL range \"%.*s\" past end\n", (int)elen, enc);
+        return -1;
+      }
+    }
+  }
+
+  printf("PASS range\n");
+  return 0;
+}
+
+
+#ifdef RB64U_CACHE
+/**
+ * cache_threads helper: decode tokens in a pseudo-random order, checking
+ * every result
+ */
+#define CACHE_TOKENS 32
+
+static char cache_enc[CACHE_TOKENS][16];
+static char cache_raw[CACHE_TOKENS][12];
+
+void *cache_worker(void *arg)
+{
+  b64u_cache_t *c = arg;
+  char dest[16];
+  size_t i, k, dlen;
+  unsigned seed = 0;
+
+  for (i = 0; i < 20000; i++) {
+    seed = seed * 1103515245 + 12345 + (unsigned)(size_t)&seed;
+    k = (seed >> 8) % CACHE_TOKENS;
+    if (base64url_decode_cached(c, dest, 16, cache_enc[k], 16, &dlen) < 0
+     || 12 != dlen || memcmp(dest, cache_raw[k], 12))
+      return arg;
+  }
+  return NULL;
+}
+
+/**
+ * repeated lookups hit, results match base64url_decode(), oversized inputs
+ * and small buffers bypass the cache, and concurrent use with evictions
+ * always returns the right value.
+ */
+int cache()
+{
+  b64u_cache_t *c;
+  pthread_t th[4];
+  void *ret;
+  char dest[64];
+  size_t i, j, dlen;
+  uint64_t hits, misses;
+  int t = 0;
+
+  c = base64url_cache_create(64, 16);
+  if (NULL == c) {
+    printf("FAIL cache create\n");
+    return -1;
+  }
+  for (i = 0; i < 2; i++) {
+    memset(dest, 0, 64);
+    if (base64url_decode_cached(c, dest, 63, "Zm9vYmFy", 8, &dlen) < 0 || 6 != dlen || memcmp(dest, "foobar", 6))
+      t = -1;
+  }
+  /* longer than maxkey, then too small a buffer for the cached value */
+  if (base64url_decode_cached(c, dest, 63, "Zm9vYmFyZm9vYmFy", 16, &dlen) < 0 || 12 != dlen
+   || base64url_decode_cached(c, dest, 63, "Zm9vYmFyZm9vYmFyZm9v", 20, &dlen) < 0 || 15 != dlen
+   || base64url_decode_cached(c, dest, 4, "Zm9vYmFy", 8, &dlen) >= 0)
+    t = -1;
+  base64url_cache_counters(c, &hits, &misses);
+  if (t || 1 != hits || 3 != misses) {
+    printf("FAIL cache hits=%lu misses=%lu\n", (unsigned long)hits, (unsigned long)misses);
+    base64url_cache_destroy(c);
+    return -1;
+  }
+  base64url_cache_destroy(c);
+
+  /* NULL is no cache */
+  hits = misses = 1;
+  base64url_cache_counters(NULL, &hits, &misses);
+  if (base64url_decode_cached(NULL, dest, 63, "Zm9vYmFy", 8, &dlen) < 0 || 6 != dlen
+   || memcmp(dest, "foobar", 6) || hits || misses) {
+    printf("FAIL cache NULL\n");
+    return -1;
+  }
+
+  /* fewer slots than tokens, so threads evict each other's entries */
+  srand(6);
+  for (i = 0; i < CACHE_TOKENS; i++) {
+    for (j = 0; j < 12; j++) cache_raw[i][j] = (char)rand();
+    base64url_encode(cache_enc[i], 16, cache_raw[i], 12, &dlen);
+  }
+  c = base64url_cache_create(CACHE_TOKENS / 2, 16);
+  if (NULL == c) {
+    printf("FAIL cache create\n");
+    return -1;
+  }
+  for (i = 0; i < 4; i++)
+    pthread_create(&th[i], NULL, cache_worker, c);
+  for (i = 0; i < 4; i++) {
+    pthread_join(th[i], &ret);
+    if (NULL != ret) t = -1;
+  }
+  base64url_cache_counters(c, &hits, &misses);
+  base64url_cache_destroy(c);
+  if (t || 80000 != hits + misses || 0 == hits) {
+    printf("FAIL cache threads hits=%lu misses=%lu\n", (unsigned long)hits, (unsigned long)misses);
+    return -1;
+  }
+
+  printf("PASS cache\n");
+  return 0;
+}
+#else
+/**
+ * without RB64U_CACHE there is no cache, and lookups still decode
+ */
+int cache()
+{
+  char dest[64];
+  size_t dlen;
+  uint64_t hits = 1, misses = 1;
+
+  if (NULL != base64url_cache_create(64, 16)
+   || base64url_decode_cached(NULL, dest, 63, "Zm9vYmFy", 8, &dlen) < 0 || 6 != dlen || memcmp(dest, "foobar", 6)) {
+    printf("FAIL cache disabled\n");
+    return -1;
+  }
+  base64url_cache_counters(NULL, &hits, &misses);
+  if (hits || misses) {
+    printf("FAIL cache disabled counters\n");
+    return -1;
+  }
+  printf("PASS cache (not compiled in)\n");
+  return 0;
+}
+#endif
+
+
+/**
+ * the large-buffer path agrees with the state machine for lengths around the
+ * chunk sizes, at every output alignment, and for padding or malformed input
+ * that sends it back to the state machine part way.
+ */
+int large()
+{
+  static const size_t lens[] = { 0, 1, 2, 3, 47, 3071, 3072, 3073, 4095, 4096, 4097, 10000, 20000 };
+  static char raw[20000], enc[2][27000], dec[2][20016];
+  size_t i, j, k, elen[2], dlen[2];
+  int r[2], t = 0;
+
+  srand(4);
+  for (i = 0; i < sizeof(raw); i++) raw[i] = (char)rand();
+
+  for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+    for (j = 0; j < 16; j++) {
+      for (k = 0; k < 2; k++) {
+        base64url_set_nt_threshold(k ? 0 : (size_t)-1);
+        r[k] = base64url_encode(enc[k] + j, sizeof(enc[k]) - 16, raw, lens[i], &elen[k]);
+      }
+      if (r[0] != r[1] || elen[0] != elen[1] || memcmp(enc[0] + j, enc[1] + j, elen[0])) {
+        printf("FAIL large encode len=%lu align=%lu\n", lens[i], j);
+        t = -1;
+        continue;
+      }
+      /* pad and decode; then with a stray '=' a third of the way in */
+      memcpy(enc[0] + j + elen[0], "==", 2);
+      elen[0] += (4 - elen[0] % 4) % 4;
+      for (k = 0; k < 2; k++) {
+        base64url_set_nt_threshold(k ? 0 : (size_t)-1);
+        r[k] = base64url_decode(dec[k] + j, sizeof(dec[k]) - 16, enc[0] + j, elen[0], &dlen[k]);
+      }
+      if (r[0] != r[1] || dlen[0] != dlen[1] || dlen[0] != lens[i] || memcmp(dec[0] + j, dec[1] + j, dlen[0])) {
+        printf("FAIL large decode len=%lu align=%lu\n", lens[i], j);
+        t = -1;
+        continue;
+      }
+      if (elen[0] < 3) continue;
+      enc[0][j + elen[0] / 3] = '=';
+      for (k = 0; k < 2; k++) {
+        base64url_set_nt_threshold(k ? 0 : (size_t)-1);
+        r[k] = base64url_decode(dec[k] + j, sizeof(dec[k]) - 16, enc[0] + j, elen[0], &dlen[k]);
+      }
+      if (r[0] != r[1] || dlen[0] != dlen[1] || memcmp(dec[0] + j, dec[1] + j, dlen[0])) {
+        printf("FAIL large decode stray padding len=%lu align=%lu\n", lens[i], j);
+        t = -1;
+      }
+    }
+  }
+
+  /* maxlen too small: partial output from the state machine, as below the
+   * threshold; base64url_encode_nt() itself does no work */
+  base64url_set_nt_threshold(0);
+  base64url_encode(enc[1], sizeof(enc[1]), raw, 3072, &elen[1]);
+  if (base64url_encode(enc[0], 100, raw, 3072, &elen[0]) >= 0 || 100 != elen[0]
+   || memcmp(enc[0], enc[1], 100)
+   || base64url_encode_nt(enc[0], 100, raw, 3072, &elen[0]) >= 0 || 0 != elen[0]) {
+    printf("FAIL large encode maxlen\n");
+    t = -1;
+  }
+  base64url_encode(enc[0], sizeof(enc[0]), raw, 3072, &elen[0]);
+  if (base64url_decode(dec[0], 100, enc[0], elen[0], &dlen[0]) >= 0 || 100 != dlen[0]
+   || memcmp(dec[0], raw, 100)) {
+    printf("FAIL large decode maxlen\n");
+    t = -1;
+  }
+  base64url_set_nt_threshold(RB64U_NT_THRESHOLD);
+
+  if (0 == t) printf("PASS large\n");
+  return t;
+}
+
+
+/**
+ * validation of well-formed and malformed input, and the decoded length of
+ * every valid encoding up to 64 bytes.
+ */
+int validate()
+{
+  static const struct {
+    const char *src;
+    int flags, r;
+    size_t n; /* decoded length, or error offset */
+  } cases[] = {
+    { "",              0, 0, 0 },
+    { "Zg",            0, 0, 1 },
+    { "Zg==",          0, 0, 1 },
+    { "Zm8=",          0, 0, 2 },
+    { "Zm9vYmFy",      0, 0, 6 },
+    { "Zm9vYmFyZm9vYmFy-_09", 0, 0, 15 },
+    { "Zm9vYmFyZm9vYmFy+_09", 0, -1, 16 },
+    { "Zm9vYmFyZm9vYmFy-/09", 0, -1, 17 },
+    { "Zm9vYmFyZm9vYmF\x80", 0, -1, 15 },
+    { "Z",             0, -1, 0 },
+    { "Zm9vY",         0, -1, 4 },
+    { "Zg=",           0, -1, 2 },
+    { "Zg===",         0, -1, 2 },
+    { "Zm8==",         0, -1, 3 },
+    { "Zm9v=",         0, -1, 4 },
+    { "Zg=g",          0, -1, 2 },
+    { "Zg",            RB64U_PAD_REQUIRED, -1, 2 },
+    { "Zm9v",          RB64U_PAD_REQUIRED, 0, 3 },
+    { "Zg==",          RB64U_PAD_FORBIDDEN, -1, 2 },
+    { "Zh",            0, 0, 1 },
+    { "Zh",            RB64U_CANONICAL, -1, 1 },
+    { "Zm9",           RB64U_CANONICAL, -1, 2 },
+    { "Zm8=",          RB64U_CANONICAL, 0, 2 }
+  };
+  char raw[64], enc[128];
+  size_t i, len, elen, n, at;
+  int r, t = 0;
+
+  for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    n = at = 99;
+    r = base64url_validate(cases[i].src, strlen(cases[i].src), cases[i].flags, &n, &at);
+    if (r != cases[i].r || (r < 0 ? at : n) != cases[i].n) {
+      printf("FAIL validate \"%s\" flags=%d r=%d decoded_len=%lu err_offset=%lu\n",
+        cases[i].src, cases[i].flags, r, n, at);
+      t = -1;
+    }
+  }
+
+  srand(3);
+  for (i = 0; i < 64; i++) raw[i] = (char)rand();
+  for (len = 0; len <= 64; len++) {
+    base64url_encode_padded(enc, 127, raw, len, &elen);
+    r = base64url_validate(enc, elen, RB64U_PAD_REQUIRED | RB64U_CANONICAL, &n, NULL);
+    if (r < 0 || n != len) {
+      printf("FAIL validate \"%.*s\" r=%d decoded_len=%lu\n", (int)elen, enc, r, n);
+      t = -1;
+    }
+  }
+
+  if (0 == t) printf("PASS validate\n");
+  return t;
+}
+
+
+/**
+ * constant-time codec agrees with the state machine for every length up to
+ * 64 bytes, with and without padding, and rejects characters outside the
+ * alphabet wherever they appear.
+ */
+int constant_time()
+{
+  char raw[64], enc[128], ect[128], dec[64];
+  size_t i, j, elen, clen, dlen;
+  int r, c, valid;
+
+  srand(1);
+  for (i = 0; i < 64; i++) raw[i] = (char)rand();
+
+  for (i = 0; i <= 64; i++) {
+    base64url_encode_padded(enc, 127, raw, i, &elen);
+    r = base64url_encode_ct(ect, 127, raw, i, &clen);
+    if (r != (int)(i % 3) || clen > elen || memcmp(enc, ect, clen)) {
+      printf("FAIL constant_time encode len=%lu r=%d\n", i, r);
+      return -1;
+    }
+    /* unpadded, then padded */
+    for (j = clen; j <= elen; j += (elen - clen) ? elen - clen : 1) {
+      memset(dec, 0, 64);
+      r = base64url_decode_ct(dec, 64, enc, j, &dlen);
+      if (r < 0 || dlen != i || memcmp(dec, raw, i)) {
+        printf("FAIL constant_time decode \"%.*s\" r=%d dlen=%lu\n", (int)j, enc, r, dlen);
+        return -1;
+      }
+    }
+  }
+
+  /* maxlen is checked before any work */
+  if (base64url_encode_ct(ect, 7, "foobar", 6, &clen) >= 0 || 0 != clen
+   || base64url_decode_ct(dec, 5, "Zm9vYmFy", 8, &dlen) >= 0 || 0 != dlen) {
+    printf("FAIL constant_time maxlen\n");
+    return -1;
+  }
+
+  /* a single character left over */
+  if (base64url_decode_ct(dec, 64, "Zm9vY", 5, &dlen) >= 0) {
+    printf("FAIL constant_time length\n");
+    return -1;
+  }
+
+  /* every byte value, in every position of a group */
+  for (c = 0; c < 256; c++) {
+    for (i = 0; i < 4; i++) {
+      memcpy(enc, "Zm9v", 4);
+      enc[i] = (char)c;
+      r = base64url_decode_ct(dec, 64, enc, 4, &dlen);
+      valid = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')
+           || c == '-' || c == '_' || (c == '=' && i == 3);
+      if ((r < 0) == valid) {
+        printf("FAIL constant_time alphabet c=0x%02x i=%lu r=%d\n", c, i, r);
+        return -1;
+      }
+    }
+  }
+
+  printf("PASS constant_time\n");
+  return 0;
+}
+
+
+/**
+ * decode-and-compare, fast and constant-time, against decode and validate
+ */
+int decode_equals()
+{
+  char raw[64], enc[128], dec[64], bad[64];
+  size_t i, j, k, elen, dlen;
+  int c, r, rc, want;
+
+  srand(2);
+  for (i = 0; i < 64; i++) raw[i] = (char)rand();
+
+  for (i = 0; i <= 64; i++) {
+    base64url_encode_padded(enc, 127, raw, i, &elen);
+    base64url_encode(enc, 127, raw, i, &dlen);
+    /* unpadded, then padded */
+    for (j = dlen; j <= elen; j += (elen - dlen) ? elen - dlen : 1) {
+      r = base64url_decode_equals(enc, j, raw, i);
+      rc = base64url_decode_equals_ct(enc, j, raw, i);
+      if (1 != r || 1 != rc) {
+        printf("FAIL decode_equals \"%.*s\" r=%d ct=%d\n", (int)j, enc, r, rc);
+        return -1;
+      }
+      /* a difference in any byte, or in the length */
+      for (k = 0; k < i; k++) {
+        memcpy(bad, raw, i);
+        bad[k] ^= 0x40;
+        if (base64url_decode_equals(enc, j, bad, i) || base64url_decode_equals_ct(enc, j, bad, i)) {
+          printf("FAIL decode_equals differs len=%lu at=%lu\n", i, k);
+          return -1;
+        }
+      }
+      if (base64url_decode_equals(enc, j, raw, i + 1) || base64url_decode_equals_ct(enc, j, raw, i + 1)
+       || (i > 0 && (base64url_decode_equals(enc, j, raw, i - 1) || base64url_decode_equals_ct(enc, j, raw, i - 1)))) {
+        printf("FAIL decode_equals length len=%lu\n", i);
+        return -1;
+      }
+    }
+  }
+
+  /* every byte value, in every position of a group, in both kernels */
+  for (c = 0; c < 256; c++) {
+    for (i = 0; i < 12; i++) {
+      memcpy(enc, "Zm9vYmFyYmF6", 12);
+      enc[i] = (char)c;
+      want = 0 == base64url_validate(enc, 12, 0, NULL, NULL);
+      if (want) {
+        base64url_decode(dec, 64, enc, 12, &dlen);
+        want = 9 == dlen;
+      }
+      r = base64url_decode_equals(enc, 12, want ? dec : "foobarbaz", 9);
+      rc = base64url_decode_equals_ct(enc, 12, want ? dec : "foobarbaz", 9);
+      if (r != want || rc != want) {
+        printf("FAIL decode_equals alphabet c=0x%02x i=%lu r=%d ct=%d\n", c, i, r, rc);
+        return -1;
+      }
+    }
+  }
+
+  /* malformed: a single character left over, padding out of place */
+  if (base64url_decode_equals("Zm9vY", 5, "foo", 3) || base64url_decode_equals_ct("Zm9vY", 5, "foo", 3)
+   || base64url_decode_equals("Zg===", 5, "f", 1) || base64url_decode_equals_ct("Zg===", 5, "f", 1)
+   || base64url_decode_equals("Zg=", 3, "f", 1) || base64url_decode_equals_ct("Zg=", 3, "f", 1)
+   || base64url_decode_equals("Z===", 4, "", 0) || base64url_decode_equals_ct("Z===", 4, "", 0)) {
+    printf("FAIL decode_equals malformed\n");
+    return -1;
+  }
+
+  printf("PASS decode_equals\n");
+  return 0;
+}
+
+/**
+ * runtime counters, when compiled in, track a single buffer encode and decode
+ */
+int stats()
+{
+  b64u_stats_t st;
+  char dest[64];
+  size_t dlen;
+
+  base64url_stats_reset();
+  base64url_encode(dest, 63, "foobar", 6, &dlen);
+  base64url_decode(dest, 63, "Zm9vYg", 6, &dlen);
+  base64url_encode(dest, 1, "foobar", 6, &dlen);
+
+  if (base64url_stats_get(&st) < 0) {
+    if (NULL == st.kernel || st.encode_calls || st.path[RB64U_PATH_STATE]) {
+      printf("FAIL stats disabled\n");
+      return -1;
+    }
+    printf("PASS stats (not compiled in)\n");
+    return 0;
+  }
+  if (NULL == st.kernel
+   || 2 != st.encode_calls || 1 != st.decode_calls || 0 != st.ingest_calls
+   || 7 != st.encode_in || 9 != st.encode_out
+   || 6 != st.decode_in || 4 != st.decode_out
+   || 13 != st.path[RB64U_PATH_STATE]
+   || 1 != st.errors[RB64U_ERR_MAXLEN]) {
+    printf("FAIL stats encode=%lu/%lu/%lu decode=%lu/%lu/%lu path=%lu maxlen=%lu\n",
+      (unsigned long)st.encode_calls, (unsigned long)st.encode_in, (unsigned long)st.encode_out,
+      (unsigned long)st.decode_calls, (unsigned long)st.decode_in, (unsigned long)st.decode_out,
+      (unsigned long)st.path[RB64U_PATH_STATE], (unsigned long)st.errors[RB64U_ERR_MAXLEN]);
+    return -1;
+  }
+  printf("PASS stats\n");
+  return 0;
+}
+
+
 /**
  */
 int main (int argc, char **argv)
@@ -382,5 +879,19 @@ int main (int argc, char **argv)
     r = -1;
   if (verify_all("", 0, 2)) /* max=2 */
     r = -1;
+  if (range())
+    r = -1;
+  if (validate())
+    r = -1;
+  if (large())
+    r = -1;
+  if (cache())
+    r = -1;
+  if (constant_time())
+    r = -1;
+  if (decode_equals())
+    r = -1;
+  if (stats())
+    r = -1;
   return r;
 }
\ No newline at end of file
@@ -0,0 +1,152 @@
+/**
+ * unit tests for the C++20 range adaptors, for 'make check'
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "librb64u.hpp"
+
+static_assert(std::ranges::view<rb64u::encoded_view<std::string_view>>);
+static_assert(std::ranges::input_range<rb64u::encoded_view<std::string_view>>);
+static_assert(std::ranges::view<rb64u::decoded_view<std::ranges::ref_view<std::list<char>>>>);
+static_assert(std::ranges::input_range<rb64u::decoded_view<std::string_view>::chunk_range>);
+static_assert(std::ranges::view<rb64u::encoded_view<std::ranges::basic_istream_view<char, char>>>);
+
+/**
+ * the whole buffer encoded in one call
+ */
+static std::string encode(const std::string &raw)
+{
+  std::string enc(raw.size() / 3 * 4 + 4, '\0');
+  std::size_t dlen;
+  base64url_encode(enc.data(), enc.size(), raw.data(), raw.size(), &dlen);
+  enc.resize(dlen);
+  return enc;
+}
+
+/**
+ * lengths around the block sizes, from contiguous and node-based sources,
+ * character by character and a chunk at a time
+ */
+static int roundtrip()
+{
+  static const std::size_t lens[] = { 0, 1, 2, 3, 4, 3071, 3072, 3073, 4096, 6144, 9217, 20000 };
+  std::size_t i, j;
+
+  std::srand(5);
+  for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+    std::string raw(lens[i], '\0');
+    for (j = 0; j < raw.size(); j++) raw[j] = (char)std::rand();
+    std::string want = encode(raw);
+
+    std::string got;
+    for (char c : raw | rb64u::encode_view) got += c;
+    if (got != want) {
+      std::printf("FAIL views encode string len=%lu\n", lens[i]);
+      return -1;
+    }
+
+    std::list<unsigned char> node(raw.begin(), raw.end());
+    got.clear();
+    for (char c : rb64u::encode_view(node)) got += c;
+    if (got != want) {
+      std::printf("FAIL views encode list len=%lu\n", lens[i]);
+      return -1;
+    }
+
+    std::vector<std::byte> bytes(raw.size());
+    if (!raw.empty()) std::memcpy(bytes.data(), raw.data(), raw.size());
+    auto ev = bytes | rb64u::encode_view;
+    got.clear();
+    for (std::span<const char> block : ev.chunks()) {
+      if (block.size() > 4096) {
+        std::printf("FAIL views encode chunk size=%lu\n", block.size());
+        return -1;
+      }
+      got.append(block.data(), block.size());
+    }
+    if (got != want) {
+      std::printf("FAIL views encode chunks len=%lu\n", lens[i]);
+      return -1;
+    }
+
+    /* single-pass source with an iterator that cannot be default-constructed */
+    std::istringstream in(raw);
+    in >> std::noskipws;
+    got.clear();
+    for (char c : std::views::istream<char>(in) | rb64u::encode_view) got += c;
+    if (got != want) {
+      std::printf("FAIL views encode istream len=%lu\n", lens[i]);
+      return -1;
+    }
+
+    std::istringstream text_in(want);
+    got.clear();
+    for (char c : std::views::istream<char>(text_in) | rb64u::decode_view) got += c;
+    if (got != raw) {
+      std::printf("FAIL views decode istream len=%lu\n", lens[i]);
+      return -1;
+    }
+
+    std::string_view text(want);
+    got.clear();
+    for (char c : text | rb64u::decode_view) got += c;
+    if (got != raw) {
+      std::printf("FAIL views decode len=%lu\n", lens[i]);
+      return -1;
+    }
+
+    std::list<char> chars(want.begin(), want.end());
+    auto dv = chars | rb64u::decode_view;
+    got.clear();
+    for (std::span<const char> block : dv.chunks()) got.append(block.data(), block.size());
+    if (got != raw) {
+      std::printf("FAIL views decode chunks len=%lu\n", lens[i]);
+      return -1;
+    }
+  }
+
+  std::printf("PASS views roundtrip\n");
+  return 0;
+}
+
+/**
+ * padding, including padding that ends the output before the last block
+ */
+static int padding()
+{
+  std::string got, text(std::string("Zm9vYg==") + std::string(8192, 'A'));
+
+  for (char c : std::string_view("Zm9vYmE=") | rb64u::decode_view) got += c;
+  if (got != "fooba") {
+    std::printf("FAIL views padding \"%s\"\n", got.c_str());
+    return -1;
+  }
+
+  got.clear();
+  for (char c : text | rb64u::decode_view) got += c;
+  if (got != "foob") {
+    std::printf("FAIL views padding stops output, length %lu\n", got.size());
+    return -1;
+  }
+
+  std::printf("PASS views padding\n");
+  return 0;
+}
+
+/**
+ */
+int main()
+{
+  int r = 0;
+  if (roundtrip())
+    r = -1;
+  if (padding())
+    r = -1;
+  return r;
+}